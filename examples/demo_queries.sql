@@ -0,0 +1,12 @@
+# Exact answers next to sampled estimates over data/large_data.csv.
+# Run with: ./build/aqe --cube=data:category:value examples/demo_queries.sql
+SELECT COUNT(*) FROM data
+SELECT COUNT(*) FROM data SAMPLE 10%
+SELECT SUM(value) FROM data
+SELECT SUM(value) FROM data SAMPLE 10%
+SELECT AVG(value) FROM data
+SELECT AVG(value) FROM data SAMPLE 10%
+SELECT MIN(value), MAX(value) FROM data
+SELECT MIN(value), MAX(value) FROM data SAMPLE 10%
+SELECT category, COUNT(*), SUM(value), AVG(value) FROM data GROUP BY category
+SELECT category, COUNT(*), SUM(value), AVG(value) FROM data GROUP BY category SAMPLE 20%
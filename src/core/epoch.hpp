@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <limits>
+#include <cstdint>
+
+namespace aqe {
+namespace core {
+
+// Epoch-based reclamation for data that readers use without locks. A reader
+// pins the current epoch before loading a shared pointer and unpins when it
+// is done with everything it reached through it. A writer that unpublishes an
+// object retires it instead of freeing it; the object is freed by reclaim()
+// once every reader pinned at or before its retirement has unpinned.
+//
+// Pinning claims a slot from a list that only grows and announces the epoch
+// in it, with no locks. Retiring and reclaiming take a mutex and are meant
+// for writers. Guards may be moved between threads.
+class EpochManager {
+private:
+    static constexpr uint64_t IDLE = std::numeric_limits<uint64_t>::max();
+
+    struct Slot {
+        std::atomic<uint64_t> epoch{IDLE};
+        std::atomic<bool> claimed{false};
+        Slot* next = nullptr;
+    };
+
+public:
+    // Keeps the epoch it was pinned at announced until destroyed.
+    class Guard {
+    public:
+        Guard() = default;
+        Guard(Guard&& other) noexcept : slot(other.slot) { other.slot = nullptr; }
+        Guard& operator=(Guard&& other) noexcept {
+            if (this != &other) {
+                release();
+                slot = other.slot;
+                other.slot = nullptr;
+            }
+            return *this;
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+        ~Guard() { release(); }
+
+    private:
+        friend class EpochManager;
+        Slot* slot = nullptr;
+
+        explicit Guard(Slot* pinned) : slot(pinned) {}
+
+        void release() {
+            if (!slot) return;
+            slot->epoch.store(IDLE, std::memory_order_release);
+            slot->claimed.store(false, std::memory_order_release);
+            slot = nullptr;
+        }
+    };
+
+    EpochManager() = default;
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    ~EpochManager() {
+        Slot* slot = slots.load(std::memory_order_acquire);
+        while (slot) {
+            Slot* next = slot->next;
+            delete slot;
+            slot = next;
+        }
+    }
+
+    // Loads of shared pointers made after pin() returns are safe to follow
+    // until the guard is destroyed.
+    Guard pin() {
+        Slot* slot = claim();
+        slot->epoch.store(global_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+        return Guard(slot);
+    }
+
+    // Takes over an object the caller has just unpublished. It is freed by a
+    // later reclaim() once no reader can still reach it.
+    void retire(std::shared_ptr<const void> object) {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t epoch = global_epoch.fetch_add(1, std::memory_order_seq_cst);
+        retired.push_back(Retired{epoch, std::move(object)});
+    }
+
+    // Frees retired objects no pinned reader can reach. Returns how many.
+    size_t reclaim() {
+        uint64_t oldest = IDLE;
+        for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+            oldest = std::min(oldest, slot->epoch.load(std::memory_order_seq_cst));
+        }
+        std::vector<std::shared_ptr<const void>> freed;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            size_t kept = 0;
+            for (auto& entry : retired) {
+                if (entry.epoch < oldest) {
+                    freed.push_back(std::move(entry.object));
+                } else {
+                    retired[kept++] = std::move(entry);
+                }
+            }
+            retired.resize(kept);
+        }
+        return freed.size(); // destroyed outside the lock
+    }
+
+    size_t retiredCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return retired.size();
+    }
+
+    uint64_t epoch() const { return global_epoch.load(std::memory_order_relaxed); }
+
+private:
+    struct Retired {
+        uint64_t epoch;
+        std::shared_ptr<const void> object;
+    };
+
+    std::atomic<uint64_t> global_epoch{0};
+    std::atomic<Slot*> slots{nullptr};
+    mutable std::mutex mutex;
+    std::vector<Retired> retired;
+
+    Slot* claim() {
+        for (Slot* slot = slots.load(std::memory_order_acquire); slot; slot = slot->next) {
+            bool expected = false;
+            if (!slot->claimed.load(std::memory_order_relaxed) &&
+                slot->claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return slot;
+            }
+        }
+        auto* slot = new Slot();
+        slot->claimed.store(true, std::memory_order_relaxed);
+        Slot* head = slots.load(std::memory_order_relaxed);
+        do {
+            slot->next = head;
+        } while (!slots.compare_exchange_weak(head, slot, std::memory_order_release, std::memory_order_relaxed));
+        return slot;
+    }
+};
+
+} // namespace core
+} // namespace aqe
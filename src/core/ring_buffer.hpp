@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+namespace aqe {
+namespace core {
+
+// Bounded lock-free queue for many producers and one consumer. Each cell
+// carries a sequence number that says whose turn it is: producers claim a
+// position with a CAS on the tail and publish the cell by advancing its
+// sequence, and the consumer frees the cell by advancing it again, a lap
+// ahead. Neither side takes a lock, and producers contend only on the tail.
+// Values must be default-constructible and movable.
+template <typename T>
+class MpscRingBuffer {
+public:
+    // `capacity` is rounded up to a power of two.
+    explicit MpscRingBuffer(size_t capacity) {
+        if (capacity == 0) throw std::invalid_argument("Ring buffer capacity must be positive");
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        mask = size - 1;
+        cells = std::make_unique<Cell[]>(size);
+        for (size_t i = 0; i < size; ++i) cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    MpscRingBuffer(const MpscRingBuffer&) = delete;
+    MpscRingBuffer& operator=(const MpscRingBuffer&) = delete;
+
+    // Safe from any number of threads. False if the buffer is full; `value`
+    // is left untouched then.
+    bool tryPush(T& value) {
+        size_t position = tail.load(std::memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            auto lag = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+            if (lag == 0) {
+                if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    cell.value = std::move(value);
+                    cell.sequence.store(position + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Retries tryPush() with backoff until there is room.
+    void push(T value) {
+        for (unsigned attempt = 0; !tryPush(value); ++attempt) backoff(attempt);
+    }
+
+    // Consumer only. False if the buffer is empty.
+    bool tryPop(T& out) {
+        Cell& cell = cells[head & mask];
+        if (cell.sequence.load(std::memory_order_acquire) != head + 1) return false;
+        out = std::move(cell.value);
+        cell.value = T();
+        cell.sequence.store(head + mask + 1, std::memory_order_release);
+        ++head;
+        return true;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    // Spins briefly, then yields, then sleeps: for callers waiting on the
+    // other side of the buffer.
+    static void backoff(unsigned attempt) {
+        if (attempt < 64) return;
+        if (attempt < 128) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence{0};
+        T value{};
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> tail{0};
+    alignas(64) size_t head = 0; // consumer's
+};
+
+} // namespace core
+} // namespace aqe
@@ -7,6 +7,8 @@
 #include <unordered_map>
 #include <stdexcept>
 #include <string>
+#include <cstdint>
+#include <functional>
 
 namespace aqe {
 namespace core {
@@ -39,8 +41,14 @@ public:
         }
     }
 
+    // Decides whether the next item of the stream is sampled, without storing
+    // it. Lets callers filter a stream in place instead of copying items.
+    bool accept() {
+        return dist(gen) < sampling_rate;
+    }
+
     void add(const T& item) override {
-        if (dist(gen) < sampling_rate) {
+        if (accept()) {
             sample.push_back(item);
         }
     }
@@ -74,9 +82,13 @@ public:
         }
     }
 
-    void add(const T& item) override {
+    bool accept() {
         current_count++;
-        if (current_count > 0 && current_count % step_size == 0) {
+        return current_count % step_size == 0;
+    }
+
+    void add(const T& item) override {
+        if (accept()) {
             sample.push_back(item);
         }
     }
@@ -182,5 +194,67 @@ public:
     }
 };
 
+// Universe (hashed) sampling: an item is kept iff the hash of its key falls
+// in the lowest `rate` fraction of the hash space. The decision depends only
+// on the key, so two tables sampled at the same rate keep the same key
+// subset, and joining them yields a sample of the full join at that rate
+// rather than at rate squared. Samples at a lower rate are subsets of samples
+// at a higher one.
+template<typename T, typename KeyExtractor>
+class UniverseSampling : public SamplingStrategy<T> {
+private:
+    double sampling_rate;
+    uint64_t threshold;
+    KeyExtractor key_extractor;
+    std::vector<T> sample;
+
+public:
+    UniverseSampling(double rate, KeyExtractor extractor)
+        : sampling_rate(rate), key_extractor(extractor) {
+        if (rate <= 0.0 || rate > 1.0) {
+            throw std::invalid_argument("Sampling rate must be between 0 and 1");
+        }
+        double scaled = std::ldexp(rate, 64);
+        threshold = scaled >= std::ldexp(1.0, 64) ? UINT64_MAX : static_cast<uint64_t>(scaled);
+    }
+
+    // True if items with this key are in the sample.
+    bool acceptKey(const std::string& key) const {
+        return hashKey(key) <= threshold;
+    }
+
+    bool accept(const T& item) const {
+        return acceptKey(key_extractor(item));
+    }
+
+    void add(const T& item) override {
+        if (accept(item)) {
+            sample.push_back(item);
+        }
+    }
+
+    std::vector<T> getSample() const override {
+        return sample;
+    }
+
+    void clear() override {
+        sample.clear();
+    }
+
+    double getSamplingRate() const override {
+        return sampling_rate;
+    }
+
+    // std::hash finalized with the splitmix64 mixer so that its low-entropy
+    // outputs (e.g. for short keys) spread evenly over the 64-bit range.
+    static uint64_t hashKey(const std::string& key) {
+        uint64_t h = static_cast<uint64_t>(std::hash<std::string>{}(key));
+        h += 0x9E3779B97F4A7C15ULL;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+        return h ^ (h >> 31);
+    }
+};
+
 } // namespace core
 } // namespace aqe
\ No newline at end of file
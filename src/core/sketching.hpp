@@ -84,24 +84,29 @@ private:
     static constexpr size_t NUM_HASH_FUNCTIONS = 3;
     std::vector<bool> bits;
     size_t num_bits;
-    std::array<std::hash<std::string>, NUM_HASH_FUNCTIONS> hashers;
 
-    size_t getIndex(const std::string& item, size_t hash_function) const {
-        return hashers[hash_function](item) % num_bits;
+    // Double hashing: the i-th probe is h1 + i * h2, with h2 derived from h1
+    // by a 64-bit mix so the probes are independent (and h2 is odd).
+    size_t getIndex(size_t hash, size_t hash_function) const {
+        uint64_t h2 = static_cast<uint64_t>(hash) * 0x9E3779B97F4A7C15ULL;
+        h2 ^= h2 >> 32;
+        return static_cast<size_t>((hash + hash_function * (h2 | 1)) % num_bits);
     }
 
 public:
     BloomFilter(size_t size = 10000) : num_bits(size), bits(size, false) {}
 
     void add(const std::string& item) {
+        size_t hash = std::hash<std::string>{}(item);
         for (size_t i = 0; i < NUM_HASH_FUNCTIONS; ++i) {
-            bits[getIndex(item, i)] = true;
+            bits[getIndex(hash, i)] = true;
         }
     }
 
     bool mightContain(const std::string& item) const {
+        size_t hash = std::hash<std::string>{}(item);
         for (size_t i = 0; i < NUM_HASH_FUNCTIONS; ++i) {
-            if (!bits[getIndex(item, i)]) {
+            if (!bits[getIndex(hash, i)]) {
                 return false;
             }
         }
@@ -2,127 +2,510 @@
 #include <fstream>
 #include <string>
 #include <vector>
-#include <iomanip>
+#include <cstring>
+#include <optional>
+#include <csignal>
+#include <cstdlib>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #include "query/parser.hpp"
 #include "query/executor.hpp"
+#include "query/plan_cache.hpp"
+#include "query/result_cache.hpp"
+#include "query/shared_scan.hpp"
+#include "query/planner.hpp"
+#include "query/cube.hpp"
+#include "query/catalog.hpp"
+#include "query/cancellation.hpp"
+#include "query/result_writer.hpp"
+#include "query/stream_ingest.hpp"
+#include "query/compactor.hpp"
+#include "server/query_server.hpp"
 #include "utils/benchmark.hpp"
 #include "utils/string_utils.hpp"
 
 using namespace aqe::query;
 using namespace aqe::utils;
 
-std::vector<DataRow> loadDataFromCSV(const std::string& filename) {
-    std::vector<DataRow> data;
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        std::cerr << "Error: Could not open data file: " << filename << std::endl;
-        return data;
+static const char* USAGE =
+    "Usage: aqe [options] [QUERY_FILE]\n"
+    "\n"
+    "Loads the data once, then runs the queries in QUERY_FILE (one per line,\n"
+    "'-' for stdin), starts an interactive prompt, or serves queries.\n"
+    "\n"
+    "  --data=PATH               CSV loaded as table 'data' (default data/large_data.csv)\n"
+    "  --table=NAME=PATH         load another CSV as table NAME (repeatable)\n"
+    "  --cube=TABLE:DIMS:MEASURES  declare a cube, columns comma-separated (repeatable)\n"
+    "  --repl                    interactive prompt (default when stdin is a terminal)\n"
+    "  --format=table|csv|tsv|json\n"
+    "  --query-timeout-ms=N      fail queries still running after N ms\n"
+    "  --serve=SOCKET_PATH       serve queries on a Unix socket\n"
+    "  --port=PORT               serve queries on 127.0.0.1:PORT\n"
+    "  --max-in-flight=N         server: queries run at once\n"
+    "  --max-memory-mb=N         server: estimated memory of running queries\n"
+    "  --ingest=TABLE[:PATH]     append CSV rows from PATH (default stdin) to TABLE\n"
+    "                            while queries run; a new TABLE takes its columns\n"
+    "                            from the first line\n"
+    "  --ingest-batch-rows=N     rows appended per micro-batch\n"
+    "  --ingest-threads=N        threads parsing ingested lines (rows may then\n"
+    "                            arrive out of input order)\n"
+    "  --compact-interval-ms=N   while ingesting, merge small segments every N ms\n"
+    "                            (0 disables compaction; default 1000)\n"
+    "  --help                    show this message\n";
+
+struct Options {
+    std::vector<std::pair<std::string, std::string>> tables = {{"data", "data/large_data.csv"}};
+    std::vector<CubeDefinition> cubes;
+    std::optional<std::string> query_file;
+    bool repl = false;
+    std::optional<OutputFormat> format;
+    std::optional<long> query_timeout_ms;
+    std::optional<std::string> serve_path;
+    std::optional<uint16_t> serve_port;
+    std::optional<size_t> max_in_flight;
+    std::optional<size_t> max_memory_mb;
+    std::optional<std::string> ingest_table;
+    std::string ingest_path = "-";
+    IngestOptions ingest;
+    long compact_interval_ms = 1000;
+};
+
+static std::vector<std::string> splitList(const std::string& text, char separator) {
+    std::vector<std::string> items;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(separator, start);
+        if (end == std::string::npos) end = text.size();
+        if (end > start) items.push_back(trim(text.substr(start, end - start)));
+        start = end + 1;
     }
+    return items;
+}
 
-    std::string line;
-    std::getline(file, line);
-    std::vector<std::string> headers = splitCSV(line);
-    
-    while (std::getline(file, line)) {
-        if (line.empty() || line == "\r") continue;
-        DataRow row;
-        auto values = splitCSV(line);
-        for (size_t i = 0; i < headers.size() && i < values.size(); ++i) {
-            row.values[headers[i]] = values[i];
+// Throws std::invalid_argument for anything it does not recognize.
+static Options parseOptions(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&](const char* name) -> std::optional<std::string> {
+            size_t length = std::strlen(name);
+            if (arg.compare(0, length, name) != 0) return std::nullopt;
+            return arg.substr(length);
+        };
+        if (arg == "--help" || arg == "-h") {
+            std::cout << USAGE;
+            std::exit(0);
+        } else if (auto v = value("--data=")) {
+            options.tables[0].second = *v;
+        } else if (auto v = value("--table=")) {
+            size_t eq = v->find('=');
+            if (eq == std::string::npos || eq == 0) throw std::invalid_argument("Expected --table=NAME=PATH");
+            options.tables.emplace_back(v->substr(0, eq), v->substr(eq + 1));
+        } else if (auto v = value("--cube=")) {
+            auto parts = splitList(*v, ':');
+            if (parts.size() != 3) throw std::invalid_argument("Expected --cube=TABLE:DIMS:MEASURES");
+            options.cubes.push_back({"cube" + std::to_string(options.cubes.size() + 1), parts[0],
+                                     splitList(parts[1], ','), splitList(parts[2], ',')});
+        } else if (arg == "--repl") {
+            options.repl = true;
+        } else if (auto v = value("--format=")) {
+            options.format = parseOutputFormat(*v);
+        } else if (auto v = value("--query-timeout-ms=")) {
+            options.query_timeout_ms = std::stol(*v);
+        } else if (auto v = value("--serve=")) {
+            options.serve_path = *v;
+        } else if (auto v = value("--port=")) {
+            options.serve_port = static_cast<uint16_t>(std::stoul(*v));
+        } else if (auto v = value("--max-in-flight=")) {
+            options.max_in_flight = std::stoul(*v);
+        } else if (auto v = value("--max-memory-mb=")) {
+            options.max_memory_mb = std::stoul(*v);
+        } else if (auto v = value("--ingest=")) {
+            size_t colon = v->find(':');
+            options.ingest_table = v->substr(0, colon);
+            if (colon != std::string::npos) options.ingest_path = v->substr(colon + 1);
+            if (options.ingest_table->empty()) throw std::invalid_argument("Expected --ingest=TABLE[:PATH]");
+        } else if (auto v = value("--ingest-batch-rows=")) {
+            options.ingest.batch_rows = std::stoul(*v);
+        } else if (auto v = value("--ingest-threads=")) {
+            options.ingest.parser_threads = std::stoul(*v);
+        } else if (auto v = value("--compact-interval-ms=")) {
+            options.compact_interval_ms = std::stol(*v);
+        } else if ((arg == "-" || arg[0] != '-') && !options.query_file) {
+            options.query_file = arg;
+        } else {
+            throw std::invalid_argument("Unknown argument '" + arg + "'");
         }
-        data.push_back(row);
     }
-    return data;
+    return options;
+}
+
+static bool stdinIsTerminal() {
+#ifdef _WIN32
+    return _isatty(_fileno(stdin));
+#else
+    return isatty(STDIN_FILENO);
+#endif
 }
 
-void printResults(const QueryResult& result) {
-    const auto& headers = result.getColumnNames();
-    const auto& rows = result.getRows();
-    
-    if (headers.empty()) return;
+// Strips surrounding whitespace and trailing semicolons; comment lines
+// ('#' or '--') become empty.
+static std::string cleanQuery(const std::string& line) {
+    std::string text = trim(line);
+    if (text.rfind("#", 0) == 0 || text.rfind("--", 0) == 0) return "";
+    while (!text.empty() && text.back() == ';') text.pop_back();
+    return trim(text);
+}
 
-    std::vector<size_t> widths;
-    for (const auto& header : headers) {
-        widths.push_back(header.length());
+static std::shared_ptr<CancellationToken> newToken(const Options& options) {
+    if (options.query_timeout_ms) {
+        return CancellationToken::withTimeout(std::chrono::milliseconds(*options.query_timeout_ms));
     }
+    return std::make_shared<CancellationToken>();
+}
 
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size() && i < widths.size(); ++i) {
-            if (row[i].length() > widths[i]) {
-                widths[i] = row[i].length();
-            }
+// The query the prompt is running, cancelled by Ctrl-C.
+static std::atomic<CancellationToken*> interrupted_query{nullptr};
+
+#ifdef __linux__
+static aqe::server::QueryServer* running_server = nullptr;
+
+static void stopServer(int) {
+    if (running_server) running_server->stop();
+}
+#endif
+
+static void interruptQuery(int) {
+    if (CancellationToken* token = interrupted_query.load()) {
+        token->cancel();
+    } else {
+        std::_Exit(130);
+    }
+}
+
+static int runServer(const Catalog& catalog, const Options& opts, std::ostream& log) {
+#ifdef __linux__
+    aqe::server::ServerOptions options;
+    options.unix_path = opts.serve_path.value_or("");
+    options.tcp_port = opts.serve_port.value_or(0);
+    options.format = opts.format.value_or(OutputFormat::JSON_LINES);
+    if (opts.max_in_flight) options.admission.max_in_flight = *opts.max_in_flight;
+    if (opts.max_memory_mb) options.admission.max_memory_bytes = *opts.max_memory_mb << 20;
+    if (opts.query_timeout_ms) options.query_timeout = std::chrono::milliseconds(*opts.query_timeout_ms);
+    try {
+        aqe::server::QueryServer server(catalog, options);
+        server.listen();
+        running_server = &server;
+        std::signal(SIGINT, stopServer);
+        std::signal(SIGTERM, stopServer);
+        if (opts.serve_path) {
+            log << "Serving queries on " << *opts.serve_path << "\n";
+        } else {
+            log << "Serving queries on 127.0.0.1:" << server.port() << "\n";
         }
+        server.run();
+        running_server = nullptr;
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
+    return 0;
+#else
+    (void)catalog;
+    (void)opts;
+    (void)log;
+    std::cerr << "Error: server mode is only available on Linux" << std::endl;
+    return 1;
+#endif
+}
+
+// Runs a list of queries against the loaded catalog. Queries that miss the
+// result cache are planned together and answered by one shared scan per
+// table; a query that fails or times out leaves the scan on its own and its
+// error is reported against it.
+static int runBatch(const Catalog& catalog, const std::vector<std::string>& queries, const Options& options,
+                    const ResultWriter& writer, std::ostream& log) {
+    PlanCache plan_cache;
+    ResultCache result_cache;
+    Catalog::Snapshot snapshot = catalog.snapshot();
+    const uint64_t data_version = snapshot->version();
 
-    // Print headers
-    for (size_t i = 0; i < headers.size(); ++i) {
-        std::cout << std::left << std::setw(widths[i] + 2) << headers[i];
+    Timer timer;
+    std::vector<std::shared_ptr<const QueryResult>> results(queries.size());
+    std::vector<std::string> errors(queries.size());
+    std::vector<std::unique_ptr<Query>> parsed(queries.size());
+    std::vector<PhysicalPlan> plans;
+    std::vector<size_t> plan_owners;
+
+    for (size_t i = 0; i < queries.size(); ++i) {
+        try {
+            parsed[i] = plan_cache.get(queries[i]);
+            results[i] = result_cache.lookup(*parsed[i], data_version);
+            if (!results[i]) {
+                plans.push_back(snapshot->plan(*parsed[i]));
+                plans.back().cancellation = newToken(options);
+                plan_owners.push_back(i);
+            }
+        } catch (const std::exception& e) {
+            errors[i] = e.what();
+        }
     }
-    std::cout << std::endl;
 
-    // Print separator
-    for (size_t width : widths) {
-        std::cout << std::string(width + 2, '-');
+    std::vector<std::exception_ptr> failures;
+    auto shared_results = executeShared(plans, *snapshot, failures);
+    for (size_t p = 0; p < shared_results.size(); ++p) {
+        if (!failures[p]) {
+            results[plan_owners[p]] = std::move(shared_results[p]);
+            continue;
+        }
+        try {
+            std::rethrow_exception(failures[p]);
+        } catch (const std::exception& e) {
+            errors[plan_owners[p]] = e.what();
+        }
+    }
+    for (size_t i : plan_owners) {
+        if (results[i]) result_cache.store(*parsed[i], data_version, results[i]);
+    }
+    long long elapsed = timer.elapsed();
+    size_t scanning = 0;
+    for (const auto& plan : plans) {
+        if (plan.access == AccessPath::TABLE_SCAN) ++scanning;
     }
-    std::cout << std::endl;
 
-    // Print rows
-    for (const auto& row : rows) {
-        for (size_t i = 0; i < row.size() && i < widths.size(); ++i) {
-            std::cout << std::left << std::setw(widths[i] + 2) << row[i];
+    // Everything after the run is formatted into one buffer and written once.
+    log.flush();
+    bool table = writer.outputFormat() == OutputFormat::TABLE;
+    size_t failed = 0;
+    std::string out;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        if (table) out += "\n> " + queries[i] + "\n";
+        if (results[i]) {
+            writer.append(*results[i], out);
+            continue;
+        }
+        ++failed;
+        if (table) {
+            out += "Error: " + errors[i] + "\n";
+        } else {
+            std::cerr << "Error: " << errors[i] << " (" << queries[i] << ")\n";
         }
-        std::cout << std::endl;
     }
+    ResultWriter::flush(out);
+    log << "\nExecuted " << queries.size() << " queries (" << scanning << " in one shared scan) in " << elapsed
+        << "ms\n";
+    return failed == 0 ? 0 : 1;
+}
 
-    if (result.isApproximate()) {
-        std::cout << "\nNote: Results are approximate." << std::endl;
+static void listTables(const Catalog& catalog) {
+    Catalog::Snapshot snapshot = catalog.snapshot();
+    for (const auto& name : snapshot->tableNames()) {
+        const Table& table = snapshot->table(name);
+        std::cout << name << " (" << table.rows.size() << " rows in " << table.rows.segmentCount() << " segments):";
+        for (const auto& column : table.schema) std::cout << ' ' << column;
+        std::cout << '\n';
     }
 }
 
-int main() {
-    std::cout << "Approximate Query Engine Demo\n";
-    std::cout << "----------------------------\n";
-    auto data = loadDataFromCSV("data/large_data.csv");
-    if (data.empty()) return 1;
-    std::cout << "Loaded " << data.size() << " rows from data/large_data.csv\n";
-    
-    QueryParser parser;
-    
-    std::vector<std::pair<std::string, std::string>> queries = {
-        {"Total Row Count (Exact)", "SELECT COUNT(*) FROM data"},
-        {"Approximate Total Row Count (10% Sample)","SELECT COUNT(*) FROM data SAMPLE 10%"},
-        {"Total Sum of 'value' (Exact)", "SELECT SUM(value) FROM data"},
-        {"Approximate Total Sum of 'value' (10% Sample)", "SELECT SUM(value) FROM data SAMPLE 10%"},
-        {"Overall Average of 'value' (Exact)", "SELECT AVG(value) FROM data"},
-        {"Approximate Overall Average of 'value' (10% Sample)", "SELECT AVG(value) FROM data SAMPLE 10%"},
-        {"Min and Max of 'value' (Exact)", "SELECT MIN(value), MAX(value) FROM data"},
-        {"Approximate Min and Max of 'value' (10% Sample)", "SELECT MIN(value), MAX(value) FROM data SAMPLE 10%"},
-
-
-        {"GROUP BY with COUNT, SUM and AVG", "SELECT category, COUNT(*), SUM(value), AVG(value) FROM data GROUP BY category"},
-        {"Approximate GROUP BY with COUNT, SUM and AVG (20% Sample)", "SELECT category, COUNT(*), SUM(value), AVG(value) FROM data GROUP BY category SAMPLE 20%"},
-    
-        // {"Complex Query with Aliases", "SELECT category, COUNT(*) AS item_count, AVG(value) AS average_price FROM data GROUP BY category"}
-    };
-    
-    for (const auto& [description, query_str] : queries) {
-        std::cout << "\nExecuting: " << description << "...\n";
-        
+// Reads one query or dot-command per line. Ctrl-C cancels the running query;
+// at the prompt it exits.
+static int runRepl(const Catalog& catalog, const Options& options, ResultWriter writer) {
+    static const char* HELP =
+        ".tables            list loaded tables and their columns\n"
+        ".explain QUERY     show the physical plan of a query\n"
+        ".format NAME       table, csv, tsv or json\n"
+        ".timing on|off     print the time each query takes\n"
+        ".quit              leave\n";
+    PlanCache plan_cache;
+    ResultCache result_cache;
+    bool timing = true;
+    bool prompt = stdinIsTerminal();
+    std::signal(SIGINT, interruptQuery);
+    if (prompt) std::cout << "Enter queries, or .help for commands.\n";
+
+    std::string line;
+    while (true) {
+        if (prompt) std::cout << "aqe> " << std::flush;
+        if (!std::getline(std::cin, line)) break;
+        std::string text = cleanQuery(line);
+        if (text.empty()) continue;
+
         try {
-            Timer timer;
+            if (text[0] == '.') {
+                size_t space = text.find(' ');
+                std::string command = text.substr(0, space);
+                std::string argument = space == std::string::npos ? "" : trim(text.substr(space + 1));
+                if (command == ".quit" || command == ".exit") {
+                    break;
+                } else if (command == ".help") {
+                    std::cout << HELP;
+                } else if (command == ".tables") {
+                    listTables(catalog);
+                } else if (command == ".explain") {
+                    auto query = plan_cache.get(argument);
+                    Catalog::Snapshot snapshot = catalog.snapshot();
+                    std::cout << snapshot->plan(*query).explain();
+                } else if (command == ".format") {
+                    writer = ResultWriter(parseOutputFormat(argument));
+                } else if (command == ".timing") {
+                    timing = argument != "off";
+                } else {
+                    throw std::invalid_argument("Unknown command " + command + "; try .help");
+                }
+                continue;
+            }
 
-            QueryExecutor executor; // A fresh executor for each query
-            auto query = parser.parse(query_str);
-            auto result = executor.execute(*query, data);
-            
-            printResults(*result);
-            std::cout << "Execution time: " << timer.elapsed() << "ms\n";
-            
+            Timer timer;
+            auto query = plan_cache.get(text);
+            Catalog::Snapshot snapshot = catalog.snapshot();
+            std::shared_ptr<const QueryResult> result = result_cache.lookup(*query, snapshot->version());
+            if (!result) {
+                PhysicalPlan plan = snapshot->plan(*query);
+                auto token = newToken(options);
+                plan.cancellation = token;
+                interrupted_query = token.get();
+                try {
+                    result = executeQuery(plan, *snapshot);
+                } catch (...) {
+                    interrupted_query = nullptr;
+                    throw;
+                }
+                interrupted_query = nullptr;
+                result_cache.store(*query, snapshot->version(), result);
+            }
+            std::cout.flush();
+            writer.write(*result);
+            if (timing) std::cerr << "(" << result->rowCount() << " rows, " << timer.elapsed() << "ms)\n";
         } catch (const std::exception& e) {
             std::cerr << "Error: " << e.what() << "\n";
         }
     }
-    
     return 0;
-}
\ No newline at end of file
+}
+
+static std::vector<std::string> readQueries(std::istream& in) {
+    std::vector<std::string> queries;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::string text = cleanQuery(line);
+        if (!text.empty()) queries.push_back(text);
+    }
+    return queries;
+}
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << "\n\n" << USAGE;
+        return 1;
+    }
+    bool serving = options.serve_path || options.serve_port;
+    bool interactive = !serving && (options.repl || (!options.query_file && stdinIsTerminal()));
+    ResultWriter writer(options.format.value_or(OutputFormat::TABLE));
+
+    // Outside the prompt, machine-readable formats keep stdout for results only.
+    std::ostream& log =
+        interactive || (!serving && writer.outputFormat() == OutputFormat::TABLE) ? std::cout : std::cerr;
+    Catalog catalog;
+    try {
+        for (const auto& [name, path] : options.tables) {
+            Timer timer;
+            auto table = catalog.loadCSV(name, path);
+            log << "Loaded " << table->rows.size() << " rows from " << path << " as '" << name << "' in "
+                << timer.elapsed() << "ms\n";
+        }
+        for (const auto& cube : options.cubes) catalog.declareCube(cube);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (options.ingest_table && options.ingest_path == "-" &&
+        (interactive || (!serving && (!options.query_file || *options.query_file == "-")))) {
+        std::cerr << "Error: --ingest reads stdin, so queries must come from a file or a server" << std::endl;
+        return 1;
+    }
+
+    // The ingestor opens its own stream even for stdin, so it can see how much
+    // input is already buffered when deciding to append a micro-batch.
+    std::unique_ptr<StreamIngestor> ingestor;
+    std::ifstream ingest_input;
+    if (options.ingest_table) {
+        ingest_input.open(options.ingest_path == "-" ? "/dev/stdin" : options.ingest_path);
+        if (!ingest_input.is_open()) {
+            std::cerr << "Error: Could not open ingest input: " << options.ingest_path << std::endl;
+            return 1;
+        }
+        try {
+            ingestor = std::make_unique<StreamIngestor>(catalog, *options.ingest_table, options.ingest);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+    auto ingest = [&] {
+        try {
+            size_t rows = ingestor->run(ingest_input);
+            log << "Ingested " << rows << " rows into '" << *options.ingest_table << "' in "
+                << ingestor->batchesCommitted() << " batches\n";
+        } catch (const std::exception& e) {
+            std::cerr << "Error: ingest stopped: " << e.what() << std::endl;
+        }
+    };
+
+    if (serving || interactive) {
+        // Queries run while rows arrive. A reader still blocked on its input
+        // when they finish is abandoned rather than joined.
+        std::atomic<bool> ingest_done{false};
+        std::thread ingest_thread;
+        std::unique_ptr<Compactor> compactor;
+        if (ingestor) {
+            ingest_thread = std::thread([&] { ingest(); ingest_done = true; });
+            if (options.compact_interval_ms > 0) {
+                compactor = std::make_unique<Compactor>(catalog, CompactionOptions(),
+                                                        std::chrono::milliseconds(options.compact_interval_ms));
+                compactor->start();
+            }
+        }
+        int status = serving ? runServer(catalog, options, log) : runRepl(catalog, options, writer);
+        if (compactor) compactor->stop();
+        if (ingest_thread.joinable()) {
+            ingestor->stop();
+            if (!ingest_done) {
+                std::cout.flush();
+                std::cerr.flush();
+                std::_Exit(status);
+            }
+            ingest_thread.join();
+        }
+        return status;
+    }
+
+    // A batch run reads all of its input first, so its answers are repeatable.
+    if (ingestor) {
+        ingest();
+        if (options.compact_interval_ms > 0) catalog.compact(*options.ingest_table);
+    }
+
+    std::vector<std::string> queries;
+    if (!options.query_file || *options.query_file == "-") {
+        queries = readQueries(std::cin);
+    } else {
+        std::ifstream file(*options.query_file);
+        if (!file.is_open()) {
+            std::cerr << "Error: Could not open query file: " << *options.query_file << std::endl;
+            return 1;
+        }
+        queries = readQueries(file);
+    }
+    return runBatch(catalog, queries, options, writer, log);
+}
@@ -2,152 +2,56 @@
 
 #include <string>
 #include <vector>
-#include <unordered_map>
-#include <memory>
 #include <limits>
+#include <algorithm>
 #include "parser.hpp"
 
 namespace aqe {
 namespace query {
 
-// Base class for aggregators
-class Aggregator {
-public:
-    virtual ~Aggregator() = default;
-    virtual void addValue(double value) = 0;
-    virtual double getResult() const = 0;
-};
-
-// COUNT aggregator
-class CountAggregator : public Aggregator {
-private:
-    size_t count = 0;
-
-public:
-    void addValue(double) override {
-        ++count;
-    }
-
-    double getResult() const override {
-        return static_cast<double>(count);
-    }
-};
-
-// SUM aggregator
-class SumAggregator : public Aggregator {
-private:
-    double sum = 0.0;
-
-public:
-    void addValue(double value) override {
-        sum += value;
-    }
-
-    double getResult() const override {
-        return sum;
-    }
-};
-
-// AVG aggregator
-class AvgAggregator : public Aggregator {
-private:
+// Running state for every aggregate over one input column. SUM, AVG, MIN and
+// MAX over the same column share a single state, so each value is parsed and
+// folded in once per row no matter how many aggregates read it.
+struct FusedAggregateState {
     double sum = 0.0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
     size_t count = 0;
 
-public:
-    void addValue(double value) override {
+    void addValue(double value) {
         sum += value;
+        min = std::min(min, value);
+        max = std::max(max, value);
         ++count;
     }
 
-    double getResult() const override {
-        return count > 0 ? sum / count : 0.0;
-    }
-};
-
-// MIN aggregator
-class MinAggregator : public Aggregator {
-private:
-    double min = std::numeric_limits<double>::max();
-    bool has_value = false;
-
-public:
-    void addValue(double value) override {
-        min = has_value ? std::min(min, value) : value;
-        has_value = true;
-    }
-
-    double getResult() const override {
-        return has_value ? min : 0.0;
-    }
-};
-
-// MAX aggregator
-class MaxAggregator : public Aggregator {
-private:
-    double max = std::numeric_limits<double>::lowest();
-    bool has_value = false;
-
-public:
-    void addValue(double value) override {
-        max = has_value ? std::max(max, value) : value;
-        has_value = true;
+    void merge(const FusedAggregateState& other) {
+        sum += other.sum;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        count += other.count;
     }
 
-    double getResult() const override {
-        return has_value ? max : 0.0;
-    }
-};
-
-// Class to hold aggregation results
-class AggregateResult {
-private:
-    std::unordered_map<std::string, std::unique_ptr<Aggregator>> aggregators;
-    std::vector<std::string> group_by_values;
-
-public:
-    void addAggregator(const std::string& column, AggregationType type) {
+    // `row_count` is the number of rows in the group, which is what COUNT
+    // reports regardless of the input column.
+    double getResult(AggregationType type, size_t row_count) const {
         switch (type) {
-            case AggregationType::COUNT:
-                aggregators[column] = std::make_unique<CountAggregator>();
-                break;
-            case AggregationType::SUM:
-                aggregators[column] = std::make_unique<SumAggregator>();
-                break;
-            case AggregationType::AVG:
-                aggregators[column] = std::make_unique<AvgAggregator>();
-                break;
-            case AggregationType::MIN:
-                aggregators[column] = std::make_unique<MinAggregator>();
-                break;
-            case AggregationType::MAX:
-                aggregators[column] = std::make_unique<MaxAggregator>();
-                break;
-            default:
-                break;
-        }
-    }
-
-    void addValue(const std::string& column, double value) {
-        if (auto it = aggregators.find(column); it != aggregators.end()) {
-            it->second->addValue(value);
+            case AggregationType::COUNT: return static_cast<double>(row_count);
+            case AggregationType::SUM: return sum;
+            case AggregationType::AVG: return count > 0 ? sum / count : 0.0;
+            case AggregationType::MIN: return count > 0 ? min : 0.0;
+            case AggregationType::MAX: return count > 0 ? max : 0.0;
+            default: return 0.0;
         }
     }
+};
 
-    double getResult(const std::string& column) const {
-        if (auto it = aggregators.find(column); it != aggregators.end()) {
-            return it->second->getResult();
-        }
-        return 0.0;
-    }
-
-    void setGroupByValues(const std::vector<std::string>& values) {
-        group_by_values = values;
-    }
-
-    const std::vector<std::string>& getGroupByValues() const {
-        return group_by_values;
-    }
+// One output group: its GROUP BY values, the number of rows it covers and a
+// fused state per aggregate input column.
+struct GroupAggregates {
+    std::vector<std::string> key_values;
+    size_t row_count = 0;
+    std::vector<FusedAggregateState> inputs;
 };
 
 } // namespace query
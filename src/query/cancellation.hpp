@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+namespace aqe {
+namespace query {
+
+// Thrown by a query that was cancelled or ran past its deadline.
+class QueryCancelled : public std::runtime_error {
+public:
+    explicit QueryCancelled(const std::string& message) : std::runtime_error(message) {}
+};
+
+// Shared between a running query and whoever may stop it. Executors check it
+// between row batches, so a cancelled query stops within one batch of work;
+// cancel() is safe to call from any thread. An optional deadline cancels the
+// query once it passes.
+class CancellationToken {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    CancellationToken() = default;
+
+    // A token that expires `timeout` from now.
+    static std::shared_ptr<CancellationToken> withTimeout(std::chrono::milliseconds timeout) {
+        auto token = std::make_shared<CancellationToken>();
+        token->deadline = Clock::now() + timeout;
+        token->timeout_ms = timeout.count();
+        return token;
+    }
+
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    bool isCancelled() const {
+        return cancelled.load(std::memory_order_relaxed) || (timeout_ms >= 0 && Clock::now() >= deadline);
+    }
+
+    void throwIfCancelled() const {
+        if (cancelled.load(std::memory_order_relaxed)) {
+            throw QueryCancelled("Query cancelled");
+        }
+        if (timeout_ms >= 0 && Clock::now() >= deadline) {
+            throw QueryCancelled("Query timed out after " + std::to_string(timeout_ms) + "ms");
+        }
+    }
+
+private:
+    std::atomic<bool> cancelled{false};
+    Clock::time_point deadline;
+    long long timeout_ms = -1; // no deadline
+};
+
+} // namespace query
+} // namespace aqe
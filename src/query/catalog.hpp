@@ -0,0 +1,406 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <random>
+#include <atomic>
+#include <mutex>
+#include <iterator>
+#include <cstdint>
+#include <stdexcept>
+#include <exception>
+#include "data_row.hpp"
+#include "segment.hpp"
+#include "parser.hpp"
+#include "statistics.hpp"
+#include "cube.hpp"
+#include "planner.hpp"
+#include "executor.hpp"
+#include "join.hpp"
+#include "shared_scan.hpp"
+#include "../core/epoch.hpp"
+#include "../utils/string_utils.hpp"
+
+namespace aqe {
+namespace query {
+
+// A named table at one version, with everything the planner needs about it:
+// column names in load order, statistics, and a uniform row sample kept as
+// rows arrive. Random-sample queries at or below the stored rate scan the
+// stored sample instead of the table. Never changed once published; an
+// append publishes a new Table sharing this one's segments.
+struct Table {
+    std::string name;
+    std::vector<std::string> schema;
+    SegmentedRows rows;
+    TableStatistics statistics;
+    SegmentedRows stored_sample;
+    double sample_rate = 0.0;
+};
+
+// Every table and cube of a catalog at one point in time. A published
+// version never changes, so a query planned and run against one version
+// sees each table as of a single append. Plans point into the version they
+// were planned against.
+class CatalogVersion {
+public:
+    const Table* find(const std::string& name) const {
+        auto it = tables.find(name);
+        return it == tables.end() ? nullptr : it->second.get();
+    }
+
+    const Table& table(const std::string& name) const {
+        if (const Table* t = find(name)) return *t;
+        throw std::invalid_argument("Unknown table '" + name + "'");
+    }
+
+    std::vector<std::string> tableNames() const {
+        std::vector<std::string> names;
+        for (const auto& entry : tables) names.push_back(entry.first);
+        return names;
+    }
+
+    const CubeRegistry& getCubes() const { return cubes; }
+    // Changes whenever any table's rows do; the result cache's data version.
+    // Compaction rewrites segments without changing it.
+    uint64_t version() const { return number; }
+
+    // Resolves the query's tables and plans it with their statistics and the
+    // declared cubes. Throws std::invalid_argument for an unknown table.
+    PhysicalPlan plan(std::shared_ptr<const Query> query) const {
+        const Table& source = table(query->table_name);
+        if (query->join) table(query->join->table);
+
+        PhysicalPlan physical = Planner(&source.statistics, &cubes).plan(std::move(query));
+        const Query& q = *physical.query;
+        if (physical.access == AccessPath::TABLE_SCAN && !q.join &&
+            q.sampling.method == SamplingMethod::RANDOM && source.sample_rate > 0.0 &&
+            q.sampling.rate <= source.sample_rate) {
+            physical.input_fraction = source.sample_rate;
+        }
+        return physical;
+    }
+
+    // Plans a query the caller keeps alive for the lifetime of the plan.
+    PhysicalPlan plan(const Query& query) const {
+        return plan(std::shared_ptr<const Query>(std::shared_ptr<const Query>(), &query));
+    }
+
+    // The rows a plan produced by plan() scans.
+    const SegmentedRows& scanInput(const PhysicalPlan& physical) const {
+        const Table& source = table(physical.query->table_name);
+        return physical.input_fraction < 1.0 ? source.stored_sample : source.rows;
+    }
+
+private:
+    friend class Catalog;
+    std::map<std::string, std::shared_ptr<const Table>> tables;
+    CubeRegistry cubes;
+    uint64_t number = 0;
+};
+
+// Named tables that FROM and JOIN resolve against, and the cubes declared
+// over them. One long-running process loads each dataset once and plans and
+// runs queries over any of them while rows keep arriving.
+//
+// Readers take a snapshot(): an epoch pin plus one atomic load of the current
+// version, with no locks, after which they plan and scan that version for as
+// long as they hold it. Writers (loads, appends, drops, cube declarations)
+// are serialized among themselves; each builds the next version, sharing
+// every unchanged table, segment and cube, publishes it atomically and
+// retires the old one, which is freed once no snapshot can still reach it.
+class Catalog {
+public:
+    // Fraction of each table kept as its stored sample.
+    static constexpr double DEFAULT_SAMPLE_RATE = 0.1;
+    // Capacity of the active append buffer; it is sealed when full.
+    static constexpr size_t DEFAULT_BUFFER_ROWS = 4096;
+
+    // A pinned catalog version. Plans made from it and results that point
+    // into it must not be used after it is destroyed. Movable between threads.
+    class Snapshot {
+    public:
+        const CatalogVersion& operator*() const { return *pinned; }
+        const CatalogVersion* operator->() const { return pinned; }
+
+    private:
+        friend class Catalog;
+        core::EpochManager::Guard guard;
+        const CatalogVersion* pinned;
+
+        Snapshot(core::EpochManager::Guard epoch_guard, const CatalogVersion* version)
+            : guard(std::move(epoch_guard)), pinned(version) {}
+    };
+
+    explicit Catalog(double stored_sample_rate = DEFAULT_SAMPLE_RATE, size_t append_buffer_rows = DEFAULT_BUFFER_ROWS)
+        : sample_rate(stored_sample_rate), buffer_rows(append_buffer_rows),
+          current(std::make_shared<CatalogVersion>()) {
+        if (sample_rate < 0.0 || sample_rate > 1.0) {
+            throw std::invalid_argument("Stored sample rate must be between 0 and 1");
+        }
+        if (buffer_rows == 0) {
+            throw std::invalid_argument("Append buffers need room for at least one row");
+        }
+        published.store(current.get(), std::memory_order_seq_cst);
+    }
+
+    Catalog(const Catalog&) = delete;
+    Catalog& operator=(const Catalog&) = delete;
+
+    Snapshot snapshot() const {
+        core::EpochManager::Guard guard = epochs.pin();
+        return Snapshot(std::move(guard), published.load(std::memory_order_seq_cst));
+    }
+
+    uint64_t version() const { return snapshot()->version(); }
+
+    // Registers `rows` as table `name`, replacing any table of that name.
+    // Cubes over a replaced table are rebuilt.
+    std::shared_ptr<const Table> addTable(const std::string& name, std::vector<std::string> schema,
+                                          std::vector<DataRow> rows) {
+        std::lock_guard<std::mutex> lock(writer);
+        auto table = std::make_shared<Table>();
+        table->name = name;
+        table->schema = std::move(schema);
+        table->statistics = TableStatistics::compute(rows);
+        table->sample_rate = sample_rate;
+        std::vector<DataRow> sample = sampleOf(*table, rows.begin(), rows.end());
+        table->stored_sample = SegmentedRows::fromRows(std::move(sample));
+        table->rows = SegmentedRows::fromRows(std::move(rows));
+
+        auto next = std::make_shared<CatalogVersion>(*current);
+        next->tables[name] = table;
+        next->cubes = current->cubes.without(name);
+        for (const auto& def : cube_definitions) {
+            if (def.table == name) next->cubes.declare(def, table->rows.rowSet());
+        }
+        publish(std::move(next));
+        return table;
+    }
+
+    // Loads a CSV file whose first line holds the column names.
+    std::shared_ptr<const Table> loadCSV(const std::string& name, const std::string& path) {
+        std::ifstream file(path);
+        if (!file.is_open()) {
+            throw std::runtime_error("Could not open data file: " + path);
+        }
+        std::string line;
+        std::getline(file, line);
+        std::vector<std::string> headers = utils::splitCSV(line);
+
+        std::vector<DataRow> rows;
+        while (std::getline(file, line)) {
+            if (line.empty() || line == "\r") continue;
+            DataRow row;
+            auto values = utils::splitCSV(line);
+            for (size_t i = 0; i < headers.size() && i < values.size(); ++i) {
+                row.values[headers[i]] = values[i];
+            }
+            rows.push_back(std::move(row));
+        }
+        return addTable(name, std::move(headers), std::move(rows));
+    }
+
+    // Appends a micro-batch of rows to table `name` and publishes the result
+    // as one new version, with the table's statistics, stored sample and
+    // cubes extended to match. Rows go into the table's active append buffer
+    // in place; snapshots taken earlier do not see them. Throws
+    // std::invalid_argument for an unknown table.
+    size_t appendRows(const std::string& name, std::vector<DataRow> batch) {
+        std::lock_guard<std::mutex> lock(writer);
+        const Table& old = current->table(name);
+        auto table = std::make_shared<Table>(old);
+        table->statistics = old.statistics.clone();
+        table->statistics.add(batch.begin(), batch.end());
+        std::vector<DataRow> sample = sampleOf(old, batch.begin(), batch.end());
+        table->stored_sample = old.stored_sample.appended(std::make_move_iterator(sample.begin()),
+                                                          std::make_move_iterator(sample.end()), buffer_rows);
+
+        auto next = std::make_shared<CatalogVersion>(*current);
+        next->cubes = current->cubes.withRows(name, batch.begin(), batch.end());
+        table->rows = old.rows.appended(std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()),
+                                        buffer_rows);
+        next->tables[name] = std::move(table);
+        publish(std::move(next));
+        return batch.size();
+    }
+
+    // Drops a table and the cubes declared over it.
+    bool dropTable(const std::string& name) {
+        std::lock_guard<std::mutex> lock(writer);
+        if (!current->find(name)) return false;
+        auto next = std::make_shared<CatalogVersion>(*current);
+        next->tables.erase(name);
+        next->cubes = current->cubes.without(name);
+        for (size_t i = 0; i < cube_definitions.size();) {
+            if (cube_definitions[i].table == name) {
+                cube_definitions.erase(cube_definitions.begin() + static_cast<std::ptrdiff_t>(i));
+            } else {
+                ++i;
+            }
+        }
+        publish(std::move(next));
+        return true;
+    }
+
+    // Declares a cube over a loaded table and builds it.
+    void declareCube(CubeDefinition definition) {
+        std::lock_guard<std::mutex> lock(writer);
+        const Table& source = current->table(definition.table);
+        auto next = std::make_shared<CatalogVersion>(*current);
+        next->cubes.declare(definition, source.rows.rowSet());
+        cube_definitions.push_back(std::move(definition));
+        publish(std::move(next));
+    }
+
+    // Merges runs of small sealed segments of table `name`, in its rows and
+    // its stored sample, and builds zone maps for its sealed segments. The
+    // rewrite is planned on a snapshot without the writer lock, so appends go
+    // on meanwhile, and published only if the segments it replaces are still
+    // the table's. The data version is kept: the rows are the same. Returns
+    // false if there was nothing to do or the table changed underneath.
+    bool compact(const std::string& name, const CompactionOptions& options = CompactionOptions()) {
+        Snapshot base = snapshot();
+        const Table* planned = base->find(name);
+        if (!planned) return false;
+        SegmentedRows::Compaction rows = planned->rows.planCompaction(options);
+        SegmentedRows::Compaction sample = planned->stored_sample.planCompaction(options);
+        if (rows.empty() && sample.empty()) return false;
+
+        std::lock_guard<std::mutex> lock(writer);
+        const Table* latest = current->find(name);
+        if (!latest) return false;
+        auto table = std::make_shared<Table>(*latest);
+        if (!rows.empty()) {
+            auto compacted = latest->rows.compacted(planned->rows, std::move(rows));
+            if (!compacted) return false;
+            table->rows = std::move(*compacted);
+        }
+        if (!sample.empty()) {
+            auto compacted = latest->stored_sample.compacted(planned->stored_sample, std::move(sample));
+            if (!compacted) return false;
+            table->stored_sample = std::move(*compacted);
+        }
+        auto next = std::make_shared<CatalogVersion>(*current);
+        next->tables[name] = std::move(table);
+        publish(std::move(next), false);
+        return true;
+    }
+
+    // Versions replaced but still reachable from a snapshot.
+    size_t retiredVersions() const { return epochs.retiredCount(); }
+
+private:
+    double sample_rate;
+    size_t buffer_rows;
+    mutable core::EpochManager epochs;
+    std::mutex writer;
+    // The newest version, owned by the writers; readers reach it through
+    // `published` alone.
+    std::shared_ptr<const CatalogVersion> current;
+    std::atomic<const CatalogVersion*> published{nullptr};
+    std::vector<CubeDefinition> cube_definitions;
+    std::mt19937 sample_gen{std::random_device{}()};
+
+    // Copies of the rows in [begin, end) that join `target`'s stored sample.
+    template <typename Iterator>
+    std::vector<DataRow> sampleOf(const Table& target, Iterator begin, Iterator end) {
+        std::vector<DataRow> sample;
+        if (target.sample_rate <= 0.0) return sample;
+        std::bernoulli_distribution keep(target.sample_rate);
+        for (auto it = begin; it != end; ++it) {
+            if (keep(sample_gen)) sample.push_back(*it);
+        }
+        return sample;
+    }
+
+    // Called with the writer lock held.
+    void publish(std::shared_ptr<CatalogVersion> next, bool rows_changed = true) {
+        next->number = current->number + (rows_changed ? 1 : 0);
+        published.store(next.get(), std::memory_order_seq_cst);
+        epochs.retire(std::move(current));
+        current = std::move(next);
+        epochs.reclaim();
+    }
+};
+
+// Whether a scan for `plan` may skip segments whose zone map rules out its
+// WHERE clause. Not when systematic sampling counts rows before filtering,
+// since skipped rows would shift which rows it picks.
+inline bool canSkipSegments(const PhysicalPlan& plan) {
+    const Query& query = *plan.query;
+    return plan.access == AccessPath::TABLE_SCAN && query.where && !query.join &&
+           !(query.sampling.method == SamplingMethod::SYSTEMATIC && plan.sample_before_filter);
+}
+
+// Runs a plan produced by CatalogVersion::plan() against the tables it names.
+inline std::unique_ptr<QueryResult> executeQuery(const PhysicalPlan& plan, const CatalogVersion& catalog) {
+    const Query& query = *plan.query;
+    if (query.join) {
+        return executeJoin(plan, catalog.table(query.table_name).rows.rowSet(),
+                           catalog.table(query.join->table).rows.rowSet());
+    }
+    QueryExecutor executor;
+    const SegmentedRows& input = catalog.scanInput(plan);
+    if (!canSkipSegments(plan)) return executor.execute(plan, input.rowSet());
+    return executor.execute(plan, input.rowSet([&](const ZoneMap& zones) { return zones.mayMatch(*query.where); }));
+}
+
+// Runs plans produced by CatalogVersion::plan(), sharing one scan among the
+// plans that read the same input. Joins run on their own. Results are
+// returned in the order of `plans`; a plan that fails leaves a null result
+// and its exception in `errors` without stopping the others.
+inline std::vector<std::unique_ptr<QueryResult>> executeShared(const std::vector<PhysicalPlan>& plans,
+                                                               const CatalogVersion& catalog,
+                                                               std::vector<std::exception_ptr>& errors) {
+    std::vector<std::unique_ptr<QueryResult>> results(plans.size());
+    errors.assign(plans.size(), nullptr);
+    std::map<const SegmentedRows*, std::vector<size_t>> by_input;
+    for (size_t i = 0; i < plans.size(); ++i) {
+        try {
+            if (plans[i].query->join) {
+                results[i] = executeQuery(plans[i], catalog);
+            } else {
+                by_input[&catalog.scanInput(plans[i])].push_back(i);
+            }
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+    for (const auto& [input, members] : by_input) {
+        std::vector<PhysicalPlan> group;
+        for (size_t i : members) group.push_back(plans[i]);
+        // A segment is skipped only if no plan of the group can use its rows
+        auto keep = [&group](const ZoneMap& zones) {
+            for (const auto& plan : group) {
+                if (plan.access != AccessPath::TABLE_SCAN) continue;
+                if (!canSkipSegments(plan) || zones.mayMatch(*plan.query->where)) return true;
+            }
+            return false;
+        };
+        std::vector<std::exception_ptr> group_errors;
+        auto group_results = executeShared(group, input->rowSet(keep), group_errors);
+        for (size_t k = 0; k < members.size(); ++k) {
+            results[members[k]] = std::move(group_results[k]);
+            errors[members[k]] = group_errors[k];
+        }
+    }
+    return results;
+}
+
+// As above, but throws the first plan's error instead of returning it.
+inline std::vector<std::unique_ptr<QueryResult>> executeShared(const std::vector<PhysicalPlan>& plans,
+                                                               const CatalogVersion& catalog) {
+    std::vector<std::exception_ptr> errors;
+    auto results = executeShared(plans, catalog, errors);
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    return results;
+}
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include "catalog.hpp"
+
+namespace aqe {
+namespace query {
+
+// Compacts every table of a catalog on a background thread, so the small
+// segments micro-batch appends leave behind are merged and given zone maps
+// while ingestion goes on, and scans do not slow down as segments pile up.
+// A compaction that loses a race with a replaced table is simply retried on
+// the next pass.
+class Compactor {
+public:
+    explicit Compactor(Catalog& target, CompactionOptions compaction = CompactionOptions(),
+                       std::chrono::milliseconds pass_interval = std::chrono::milliseconds(1000))
+        : catalog(target), options(compaction), interval(pass_interval) {}
+
+    Compactor(const Compactor&) = delete;
+    Compactor& operator=(const Compactor&) = delete;
+
+    ~Compactor() { stop(); }
+
+    // Starts a pass every interval until stop().
+    void start() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (worker.joinable()) return;
+        stopping = false;
+        worker = std::thread([this] { loop(); });
+    }
+
+    // Waits for a running pass to finish.
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        if (worker.joinable()) worker.join();
+    }
+
+    // Compacts each table once. Returns the tables rewritten.
+    size_t runOnce() {
+        size_t rewritten = 0;
+        std::vector<std::string> names = catalog.snapshot()->tableNames();
+        for (const auto& name : names) {
+            if (catalog.compact(name, options)) ++rewritten;
+        }
+        compactions_done.fetch_add(rewritten, std::memory_order_relaxed);
+        return rewritten;
+    }
+
+    // Table rewrites published so far.
+    size_t compactions() const { return compactions_done.load(std::memory_order_relaxed); }
+
+private:
+    Catalog& catalog;
+    CompactionOptions options;
+    std::chrono::milliseconds interval;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+    std::thread worker;
+    std::atomic<size_t> compactions_done{0};
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!wake.wait_for(lock, interval, [this] { return stopping; })) {
+            lock.unlock();
+            try {
+                runOnce();
+            } catch (const std::exception&) {
+                // A failed pass leaves the catalog as it was; try again next time
+            }
+            lock.lock();
+        }
+    }
+};
+
+} // namespace query
+} // namespace aqe
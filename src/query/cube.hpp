@@ -0,0 +1,263 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include "data_row.hpp"
+#include "segment.hpp"
+#include "parser.hpp"
+#include "aggregator.hpp"
+#include "predicate.hpp"
+#include "statistics.hpp"
+
+namespace aqe {
+namespace query {
+
+// A declared pre-aggregation: every COUNT/SUM/AVG/MIN/MAX over `measures`
+// grouped by `dimensions` of `table`.
+struct CubeDefinition {
+    std::string name;
+    std::string table;
+    std::vector<std::string> dimensions;
+    std::vector<std::string> measures;
+};
+
+// Materialized aggregate table for one CubeDefinition. Holds one fused state
+// per measure for each distinct combination of dimension values, built with
+// a single scan and kept current by append(). Any query whose grouping,
+// filter and aggregate inputs are drawn from the cube's dimensions and
+// measures is answered by rolling the cube up instead of scanning rows.
+class AggregateCube {
+private:
+    CubeDefinition definition;
+    std::vector<GroupAggregates> cells;
+    // Per cell, which dimensions its rows lack. Their key value reads "NULL"
+    // for grouping, as in a scan, but they never satisfy a comparison.
+    std::vector<std::vector<bool>> missing_dims;
+    std::unordered_map<std::string, size_t> cell_index;
+    std::string key_buffer;
+
+public:
+    explicit AggregateCube(CubeDefinition def) : definition(std::move(def)) {
+        if (definition.dimensions.empty()) {
+            throw std::invalid_argument("Cube '" + definition.name + "' needs at least one dimension");
+        }
+    }
+
+    const CubeDefinition& getDefinition() const { return definition; }
+    size_t cellCount() const { return cells.size(); }
+
+    void build(const RowSet& data) {
+        cells.clear();
+        missing_dims.clear();
+        cell_index.clear();
+        data.forEachRow([&](const DataRow& row) { append(row); });
+    }
+
+    void append(const DataRow& row) {
+        key_buffer.clear();
+        for (const auto& dim : definition.dimensions) {
+            auto value_it = row.values.find(dim);
+            if (value_it == row.values.end()) {
+                key_buffer.push_back('\x1e'); // missing, unlike a "NULL" text value
+            } else {
+                key_buffer += value_it->second;
+                key_buffer.push_back('\x1f');
+            }
+        }
+        auto [it, inserted] = cell_index.try_emplace(key_buffer, cells.size());
+        if (inserted) {
+            GroupAggregates cell;
+            std::vector<bool> missing;
+            for (const auto& dim : definition.dimensions) {
+                cell.key_values.push_back(valueOf(row, dim));
+                missing.push_back(row.values.find(dim) == row.values.end());
+            }
+            cell.inputs.resize(definition.measures.size());
+            cells.push_back(std::move(cell));
+            missing_dims.push_back(std::move(missing));
+        }
+
+        GroupAggregates& cell = cells[it->second];
+        ++cell.row_count;
+        for (size_t i = 0; i < definition.measures.size(); ++i) {
+            auto value_it = row.values.find(definition.measures[i]);
+            double value;
+            if (value_it != row.values.end() && parseNumber(value_it->second, value)) {
+                cell.inputs[i].addValue(value);
+            }
+        }
+    }
+
+    // True if `query` can be answered exactly from this cube. Sampling is
+    // ignored since the cube's answer is exact.
+    bool covers(const Query& query) const {
+        if (query.table_name != definition.table || query.join || query.hasUnboundParameters()) return false;
+        for (const auto& col : query.group_by_columns) {
+            if (dimensionIndex(col) < 0) return false;
+        }
+        for (const auto& col : query.columns) {
+            if (col.aggregation == AggregationType::NONE) {
+                bool grouped = false;
+                for (const auto& g : query.group_by_columns) grouped = grouped || g == col.name;
+                if (!grouped) return false;
+            } else if (col.aggregation != AggregationType::COUNT &&
+                       (col.expression || measureIndex(col.name) < 0)) {
+                return false;
+            }
+        }
+        return !query.where || predicateOnDimensions(*query.where);
+    }
+
+    // Re-aggregates the cube to the query's grouping. `input_columns` gives the
+    // order of the fused inputs in the returned groups.
+    std::vector<GroupAggregates> rollUp(const Query& query, const std::vector<std::string>& input_columns) const {
+        std::vector<long> group_dims;
+        for (const auto& col : query.group_by_columns) {
+            group_dims.push_back(dimensionIndex(col));
+        }
+        std::vector<long> input_measures;
+        for (const auto& col : input_columns) {
+            input_measures.push_back(measureIndex(col));
+        }
+
+        std::vector<GroupAggregates> groups;
+        std::unordered_map<std::string, size_t> group_index;
+        if (query.group_by_columns.empty()) {
+            groups.push_back({{}, 0, std::vector<FusedAggregateState>(input_columns.size())});
+        }
+
+        DataRow dims_row;
+        std::string key;
+        for (size_t c = 0; c < cells.size(); ++c) {
+            const GroupAggregates& cell = cells[c];
+            if (query.where) {
+                for (size_t d = 0; d < definition.dimensions.size(); ++d) {
+                    if (missing_dims[c][d]) {
+                        dims_row.values.erase(definition.dimensions[d]);
+                    } else {
+                        dims_row.values[definition.dimensions[d]] = cell.key_values[d];
+                    }
+                }
+                if (!matchesPredicate(*query.where, dims_row)) continue;
+            }
+
+            size_t target = 0;
+            if (!query.group_by_columns.empty()) {
+                key.clear();
+                for (long d : group_dims) {
+                    key += cell.key_values[d];
+                    key.push_back('\x1f');
+                }
+                auto [it, inserted] = group_index.try_emplace(key, groups.size());
+                if (inserted) {
+                    GroupAggregates group;
+                    for (long d : group_dims) group.key_values.push_back(cell.key_values[d]);
+                    group.inputs.resize(input_columns.size());
+                    groups.push_back(std::move(group));
+                }
+                target = it->second;
+            }
+
+            GroupAggregates& group = groups[target];
+            group.row_count += cell.row_count;
+            for (size_t i = 0; i < input_measures.size(); ++i) {
+                group.inputs[i].merge(cell.inputs[input_measures[i]]);
+            }
+        }
+        return groups;
+    }
+
+private:
+    static const std::string& valueOf(const DataRow& row, const std::string& column) {
+        static const std::string null_value = "NULL";
+        auto it = row.values.find(column);
+        return it != row.values.end() ? it->second : null_value;
+    }
+
+    long dimensionIndex(const std::string& column) const {
+        for (size_t i = 0; i < definition.dimensions.size(); ++i) {
+            if (definition.dimensions[i] == column) return static_cast<long>(i);
+        }
+        return -1;
+    }
+
+    long measureIndex(const std::string& column) const {
+        for (size_t i = 0; i < definition.measures.size(); ++i) {
+            if (definition.measures[i] == column) return static_cast<long>(i);
+        }
+        return -1;
+    }
+
+    bool predicateOnDimensions(const Predicate& predicate) const {
+        if (predicate.kind == Predicate::Kind::COMPARISON) {
+            return dimensionIndex(predicate.column) >= 0;
+        }
+        for (const auto& child : predicate.children) {
+            if (!predicateOnDimensions(child)) return false;
+        }
+        return true;
+    }
+};
+
+// The set of declared cubes. Builds a cube when it is declared, extends the
+// cubes over a table in a copy when rows are appended to it, and finds the
+// smallest cube that can answer a query. Copies share their cubes.
+class CubeRegistry {
+private:
+    std::vector<std::shared_ptr<AggregateCube>> cubes;
+
+public:
+    AggregateCube& declare(CubeDefinition definition, const RowSet& data) {
+        for (const auto& cube : cubes) {
+            if (cube->getDefinition().name == definition.name) {
+                throw std::invalid_argument("Cube '" + definition.name + "' is already declared");
+            }
+        }
+        auto cube = std::make_shared<AggregateCube>(std::move(definition));
+        cube->build(data);
+        cubes.push_back(std::move(cube));
+        return *cubes.back();
+    }
+
+    // A copy in which the cubes over `table` also hold [begin, end). Those
+    // cubes are copied before the rows are added, so readers of this
+    // registry are undisturbed; the other cubes stay shared.
+    template <typename Iterator>
+    CubeRegistry withRows(const std::string& table, Iterator begin, Iterator end) const {
+        CubeRegistry next = *this;
+        for (auto& cube : next.cubes) {
+            if (cube->getDefinition().table != table) continue;
+            cube = std::make_shared<AggregateCube>(*cube);
+            for (auto it = begin; it != end; ++it) cube->append(*it);
+        }
+        return next;
+    }
+
+    // A copy without the cubes over `table`.
+    CubeRegistry without(const std::string& table) const {
+        CubeRegistry next;
+        for (const auto& cube : cubes) {
+            if (cube->getDefinition().table != table) next.cubes.push_back(cube);
+        }
+        return next;
+    }
+
+    const AggregateCube* find(const Query& query) const {
+        const AggregateCube* best = nullptr;
+        for (const auto& cube : cubes) {
+            if (cube->covers(query) && (!best || cube->cellCount() < best->cellCount())) {
+                best = cube.get();
+            }
+        }
+        return best;
+    }
+
+    size_t size() const { return cubes.size(); }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+
+namespace aqe {
+namespace query {
+
+struct DataRow {
+    std::unordered_map<std::string, std::string> values;
+};
+
+} // namespace query
+} // namespace aqe
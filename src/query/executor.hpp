@@ -3,191 +3,527 @@
 #include <memory>
 #include <vector>
 #include <string>
-#include <unordered_map> 
-#include <sstream>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include <mutex>
+#include "data_row.hpp"
+#include "segment.hpp"
 #include "parser.hpp"
+#include "predicate.hpp"
 #include "aggregator.hpp"
-#include "../core/sampling.hpp" 
+#include "planner.hpp"
+#include "statistics.hpp"
+#include "vector_program.hpp"
+#include "window.hpp"
+#include "../core/sampling.hpp"
+#include "../utils/string_utils.hpp"
 
 namespace aqe {
 namespace query {
 
-struct DataRow {
-    std::unordered_map<std::string, std::string> values;
-};
-
+// Query output. Rows are held in native form, with aggregates as doubles and
+// group keys as strings, and are only formatted to text on the first call to
+// getRows(). Results that are serialized natively, filtered or discarded never
+// pay for number formatting.
 class QueryResult {
 private:
-    std::vector<std::vector<std::string>> rows;
+    std::vector<std::vector<Value>> values;
     std::vector<std::string> column_names;
-    bool is_approximate; 
+    bool is_approximate;
+    mutable std::once_flag format_once;
+    mutable std::vector<std::vector<std::string>> rows;
 
 public:
     QueryResult() : is_approximate(false){}
-    void addRow(const std::vector<std::string>& row) { rows.push_back(row); }
+    void addRow(const std::vector<std::string>& row) { values.emplace_back(row.begin(), row.end()); }
+    void addRow(std::vector<Value> row) { values.push_back(std::move(row)); }
     void setColumnNames(const std::vector<std::string>& names) { column_names = names; }
     void setApproximate(bool approx) { is_approximate = approx; }
-    const std::vector<std::vector<std::string>>& getRows() const { return rows; }
+    const std::vector<std::vector<Value>>& getValues() const { return values; }
+    size_t rowCount() const { return values.size(); }
     const std::vector<std::string>& getColumnNames() const { return column_names; }
-    bool isApproximate() const { return is_approximate; } 
+    bool isApproximate() const { return is_approximate; }
+
+    // Rows as text, numbers in the fixed six-decimal format of std::to_string.
+    // Formatted once; safe to call from several threads.
+    const std::vector<std::vector<std::string>>& getRows() const {
+        std::call_once(format_once, [this] {
+            rows.reserve(values.size());
+            for (const auto& row : values) {
+                std::vector<std::string> text;
+                text.reserve(row.size());
+                for (const auto& value : row) text.push_back(formatValue(value));
+                rows.push_back(std::move(text));
+            }
+        });
+        return rows;
+    }
+
+    static std::string formatValue(const Value& value) {
+        if (const double* number = std::get_if<double>(&value)) {
+            return utils::formatFixed(*number);
+        }
+        return std::get<std::string>(value);
+    }
 };
 
-class QueryExecutor {
+// Maps rows to their group's aggregate state using the strategy the planner
+// chose. Groups are kept in first-seen order.
+class GroupTable {
 private:
-    std::unique_ptr<core::SamplingStrategy<DataRow>> sampler;
-    std::unordered_map<std::string, std::unique_ptr<AggregateResult>> group_results;
+    using Group = GroupAggregates;
+
+    GroupingStrategy strategy;
+    const std::vector<std::string>& group_by_columns;
+    size_t num_inputs;
+    std::vector<Group> groups;
+    std::unordered_map<std::string, size_t> hash_index;
+    std::string key_buffer;
 
 public:
-    QueryExecutor() {}
+    GroupTable(GroupingStrategy grouping, const std::vector<std::string>& group_columns, size_t inputs)
+        : strategy(grouping), group_by_columns(group_columns), num_inputs(inputs) {
+        if (strategy == GroupingStrategy::SINGLE) {
+            addGroup({});
+        }
+    }
+
+    // Index of the row's group, which stays valid as groups are added.
+    size_t find(const DataRow& row) {
+        switch (strategy) {
+            case GroupingStrategy::SINGLE:
+                return 0;
+            case GroupingStrategy::DIRECT_INDEXED: {
+                const std::string& value = keyValue(row, group_by_columns[0]);
+                for (size_t i = 0; i < groups.size(); ++i) {
+                    if (groups[i].key_values[0] == value) return i;
+                }
+                return addGroup({value});
+            }
+            case GroupingStrategy::HASH:
+                break;
+        }
 
-    std::unique_ptr<QueryResult> execute(const Query& query, const std::vector<DataRow>& data) {
-        group_results.clear();
-        sampler.reset();
+        key_buffer.clear();
+        for (const auto& column : group_by_columns) {
+            key_buffer += keyValue(row, column);
+            key_buffer.push_back('\x1f');
+        }
+        auto [it, inserted] = hash_index.try_emplace(key_buffer, groups.size());
+        if (!inserted) return it->second;
 
-        auto result = std::make_unique<QueryResult>();
-        setupSampling(query.sampling.method != SamplingMethod::NONE ? &query.sampling : nullptr);
-        
-        std::vector<DataRow> processed_data;
-        double scaling_factor = 1.0;
+        std::vector<std::string> values;
+        values.reserve(group_by_columns.size());
+        for (const auto& column : group_by_columns) {
+            values.push_back(keyValue(row, column));
+        }
+        return addGroup(std::move(values));
+    }
+
+    Group& at(size_t index) { return groups[index]; }
+    std::vector<Group> release() { return std::move(groups); }
+    const std::vector<Group>& getGroups() const { return groups; }
+
+private:
+    static const std::string& keyValue(const DataRow& row, const std::string& column) {
+        static const std::string null_value = "NULL";
+        auto it = row.values.find(column);
+        return it != row.values.end() ? it->second : null_value;
+    }
+
+    size_t addGroup(std::vector<std::string> values) {
+        groups.push_back({std::move(values), 0, std::vector<FusedAggregateState>(num_inputs)});
+        return groups.size() - 1;
+    }
+};
+
+// Filters groups by HAVING, orders them by the query's ORDER BY items and
+// applies LIMIT, working on native aggregate state so only the surviving
+// groups are ever formatted.
+// With a LIMIT of N a bounded max-heap keeps the best N groups in
+// O(G log N) rather than sorting all G.
+class GroupOrdering {
+private:
+    const PhysicalPlan& plan;
+    double scaling_factor;
+    std::vector<long> group_index;                // per output column, -1 if not a group key
+    std::vector<const AggregateSpec*> aggregate;  // per output column, nullptr if not an aggregate
 
-        if (sampler) {
-            for (const auto& row : data) {
-                sampler->add(row);
+public:
+    GroupOrdering(const PhysicalPlan& physical_plan, double scale)
+        : plan(physical_plan), scaling_factor(scale) {
+        const Query& query = *plan.query;
+        group_index.assign(query.columns.size(), -1);
+        aggregate.assign(query.columns.size(), nullptr);
+        for (size_t i = 0; i < query.columns.size(); ++i) {
+            for (size_t g = 0; g < query.group_by_columns.size(); ++g) {
+                if (query.columns[i].aggregation == AggregationType::NONE &&
+                    query.group_by_columns[g] == query.columns[i].name) {
+                    group_index[i] = static_cast<long>(g);
+                }
+            }
+        }
+        for (const auto& agg : plan.aggregates) {
+            aggregate[agg.output_index] = &agg;
+        }
+    }
+
+    long groupIndex(size_t column) const { return group_index[column]; }
+
+    double aggregateValue(const GroupAggregates& group, const AggregateSpec& agg) const {
+        static const FusedAggregateState no_input;
+        const FusedAggregateState& state =
+            agg.input == AggregateSpec::NO_INPUT ? no_input : group.inputs[agg.input];
+        double value = state.getResult(agg.type, group.row_count);
+        if (agg.type == AggregationType::COUNT || agg.type == AggregationType::SUM) {
+            value *= scaling_factor;
+        }
+        return value;
+    }
+
+    // Evaluates HAVING on a group's native aggregate values.
+    bool passesHaving(const GroupAggregates& group) const {
+        const Query& query = *plan.query;
+        if (!query.having) return true;
+        return evaluatePredicate(*query.having, [&](const Predicate& comparison) {
+            size_t column = static_cast<size_t>(comparison.output_index);
+            if (const AggregateSpec* agg = aggregate[column]) {
+                return compareNumber(aggregateValue(group, *agg), comparison.op, comparison.value);
             }
-            processed_data = sampler->getSample();
-            result->setApproximate(true);
-            if (sampler->getSamplingRate() > 0) {
-                scaling_factor = 1.0 / sampler->getSamplingRate();
+            if (group_index[column] >= 0) {
+                return compareText(group.key_values[group_index[column]], comparison.op, comparison.value);
             }
-        } else {
-            processed_data = data;
-            result->setApproximate(false);
+            return false;
+        });
+    }
+
+    std::vector<const GroupAggregates*> select(const std::vector<GroupAggregates>& groups) const {
+        const Query& query = *plan.query;
+        size_t limit = query.limit ? *query.limit : groups.size();
+        std::vector<const GroupAggregates*> selected;
+
+        if (query.order_by.empty()) {
+            for (size_t i = 0; i < groups.size() && selected.size() < limit; ++i) {
+                if (passesHaving(groups[i])) selected.push_back(&groups[i]);
+            }
+            return selected;
         }
 
-        if (processed_data.empty() && query.group_by_columns.empty()) {
-            processRow(query, DataRow{});
-        } else {
-            for (const auto& row : processed_data) {
-                processRow(query, row);
+        auto precedes = [this](const GroupAggregates* a, const GroupAggregates* b) {
+            return compare(*a, *b) < 0;
+        };
+        if (limit < groups.size()) {
+            // `precedes` as the heap order puts the worst kept group on top
+            selected.reserve(limit);
+            for (const auto& group : groups) {
+                if (!passesHaving(group)) continue;
+                if (selected.size() < limit) {
+                    selected.push_back(&group);
+                    std::push_heap(selected.begin(), selected.end(), precedes);
+                } else if (limit > 0 && precedes(&group, selected.front())) {
+                    std::pop_heap(selected.begin(), selected.end(), precedes);
+                    selected.back() = &group;
+                    std::push_heap(selected.begin(), selected.end(), precedes);
+                }
             }
+            std::sort_heap(selected.begin(), selected.end(), precedes);
+            return selected;
+        }
+
+        for (const auto& group : groups) {
+            if (passesHaving(group)) selected.push_back(&group);
+        }
+        std::stable_sort(selected.begin(), selected.end(), precedes);
+        return selected;
+    }
+
+private:
+    // Group keys compare numerically when both parse as numbers.
+    static int compareKeys(const std::string& a, const std::string& b) {
+        double x, y;
+        if (parseNumber(a, x) && parseNumber(b, y)) {
+            return x < y ? -1 : (x > y ? 1 : 0);
+        }
+        return a.compare(b);
+    }
+
+    int compare(const GroupAggregates& a, const GroupAggregates& b) const {
+        for (const auto& item : plan.query->order_by) {
+            int cmp = 0;
+            if (const AggregateSpec* agg = aggregate[item.column_index]) {
+                double x = aggregateValue(a, *agg);
+                double y = aggregateValue(b, *agg);
+                cmp = x < y ? -1 : (x > y ? 1 : 0);
+            } else if (group_index[item.column_index] >= 0) {
+                long g = group_index[item.column_index];
+                cmp = compareKeys(a.key_values[g], b.key_values[g]);
+            }
+            if (cmp != 0) return item.descending ? -cmp : cmp;
+        }
+        return 0;
+    }
+};
+
+// Adds one result row per group that survives HAVING and ORDER BY/LIMIT,
+// moving group keys into the result and leaving aggregates as doubles.
+// Sampled COUNT and SUM are scaled by `scaling_factor`.
+inline void addGroupRows(const PhysicalPlan& plan, std::vector<GroupAggregates> groups,
+                         double scaling_factor, QueryResult& result) {
+    const Query& query = *plan.query;
+    GroupOrdering ordering(plan, scaling_factor);
+
+    std::vector<size_t> key_uses(query.group_by_columns.size(), 0);
+    for (size_t i = 0; i < query.columns.size(); ++i) {
+        if (ordering.groupIndex(i) >= 0) ++key_uses[ordering.groupIndex(i)];
+    }
+
+    for (const GroupAggregates* selected : ordering.select(groups)) {
+        GroupAggregates& group = groups[selected - groups.data()];
+        std::vector<Value> result_row(query.columns.size(), std::string());
+        for (const auto& agg : plan.aggregates) {
+            result_row[agg.output_index] = ordering.aggregateValue(group, agg);
         }
-        
-        std::vector<std::string> result_column_names;
-        for (const auto& col : query.columns) {
-            result_column_names.push_back(col.alias.empty() ? col.name : col.alias);
-        }
-        result->setColumnNames(result_column_names);
-
-        for (const auto& group_entry : group_results) {
-            const auto& agg_result = group_entry.second;
-            std::vector<std::string> result_row;
-            
-            std::unordered_map<std::string, std::string> group_by_map;
-            const auto& group_values = agg_result->getGroupByValues();
-            for(size_t i = 0; i < query.group_by_columns.size(); ++i) {
-                group_by_map[query.group_by_columns[i]] = group_values[i];
+        for (size_t i = 0; i < query.columns.size(); ++i) {
+            long g = ordering.groupIndex(i);
+            if (g < 0) continue;
+            if (key_uses[g] == 1) {
+                result_row[i] = std::move(group.key_values[g]);
+            } else {
+                result_row[i] = group.key_values[g];
             }
+        }
+        result.addRow(std::move(result_row));
+    }
+}
+
+inline std::unique_ptr<QueryResult> makeResult(const Query& query) {
+    auto result = std::make_unique<QueryResult>();
+    std::vector<std::string> result_column_names;
+    for (const auto& col : query.columns) {
+        result_column_names.push_back(col.alias.empty() ? col.name : col.alias);
+    }
+    result->setColumnNames(result_column_names);
+    result->setApproximate(query.sampling.method != SamplingMethod::NONE);
+    return result;
+}
+
+// Key extractor for samplers keyed on a column; a missing value reads as
+// "NULL", as it does for group keys.
+struct ColumnKey {
+    std::string column;
+
+    const std::string& operator()(const DataRow* row) const {
+        static const std::string null_value = "NULL";
+        auto it = row->values.find(column);
+        return it != row->values.end() ? it->second : null_value;
+    }
+};
+
+using UniverseSampler = core::UniverseSampling<const DataRow*, ColumnKey>;
+
+// Scan-side execution of a TABLE_SCAN plan: filter, sample and aggregate
+// applied to row batches as they arrive. Rows that survive filter and sample
+// are gathered into a selection, and each aggregate input is then evaluated
+// over the whole selection by its compiled VectorProgram. The pipeline holds no reference to
+// the table, so one pass over the data can feed several pipelines. Rows kept
+// by reservoir or stratified samples are held by pointer and must outlive
+// finish().
+class QueryPipeline {
+private:
+    const PhysicalPlan& plan;
+    const Predicate* filter;
+    GroupTable groups;
+    std::unique_ptr<core::SimpleRandomSampling<const DataRow*>> random;
+    std::unique_ptr<core::SystematicSampling<const DataRow*>> systematic;
+    std::unique_ptr<UniverseSampler> universe;
+    std::unique_ptr<core::SamplingStrategy<const DataRow*>> sampler;
+    std::vector<VectorProgram> inputs;
+    std::vector<const DataRow*> selection;
+    std::vector<size_t> group_of; // per selected row
+    size_t unchecked_rows;        // consumed since the last cancellation check
+
+public:
+    static constexpr size_t CANCELLATION_CHECK_ROWS = 4096;
+
+    explicit QueryPipeline(const PhysicalPlan& physical_plan)
+        : plan(physical_plan),
+          filter(plan.query->where ? &*plan.query->where : nullptr),
+          groups(plan.grouping, plan.query->group_by_columns, plan.input_columns.size()),
+          unchecked_rows(CANCELLATION_CHECK_ROWS) {
+        if (plan.query->hasUnboundParameters()) {
+            throw std::invalid_argument("Query has unbound parameters");
+        }
+        const Sampling& sampling = plan.query->sampling;
+        // Row-independent samples are decided inline, without copying rows
+        if (sampling.method == SamplingMethod::RANDOM) {
+            random = std::make_unique<core::SimpleRandomSampling<const DataRow*>>(
+                std::min(1.0, sampling.rate / plan.input_fraction));
+        } else if (sampling.method == SamplingMethod::SYSTEMATIC) {
+            systematic = std::make_unique<core::SystematicSampling<const DataRow*>>(sampling.size);
+        } else if (sampling.method == SamplingMethod::UNIVERSE) {
+            universe = std::make_unique<UniverseSampler>(sampling.rate, ColumnKey{sampling.universe_column});
+        } else {
+            sampler = createSampler(sampling);
+        }
+        for (size_t i = 0; i < plan.input_columns.size(); ++i) {
+            const auto& expression = plan.input_expressions[i];
+            inputs.push_back(expression ? VectorProgram::compile(*expression)
+                                        : VectorProgram::compileColumn(plan.input_columns[i]));
+        }
+    }
 
-            for (const auto& col : query.columns) {
-                std::string column_key = col.alias.empty() ? col.name : col.alias;
-                if (col.aggregation == AggregationType::NONE) {
-                    result_row.push_back(group_by_map[column_key]);
+    // Throws QueryCancelled if the plan was cancelled. The token is checked
+    // once per CANCELLATION_CHECK_ROWS rows however the input is batched.
+    void consume(const DataRow* begin, const DataRow* end) {
+        if (unchecked_rows >= CANCELLATION_CHECK_ROWS) {
+            plan.checkCancelled();
+            unchecked_rows = 0;
+        }
+        unchecked_rows += static_cast<size_t>(end - begin);
+        selection.clear();
+        if (random || systematic || universe) {
+            for (const DataRow* row = begin; row != end; ++row) {
+                if (plan.sample_before_filter) {
+                    if (!accept(row) || (filter && !matchesPredicate(*filter, *row))) continue;
                 } else {
-                    double final_value = agg_result->getResult(column_key);
-                    if (sampler && (col.aggregation == AggregationType::COUNT || col.aggregation == AggregationType::SUM)) {
-                        final_value *= scaling_factor;
-                    }
-                    result_row.push_back(std::to_string(final_value));
+                    if ((filter && !matchesPredicate(*filter, *row)) || !accept(row)) continue;
                 }
+                selection.push_back(row);
             }
-            result->addRow(result_row);
+        } else {
+            for (const DataRow* row = begin; row != end; ++row) {
+                if (filter && !matchesPredicate(*filter, *row)) continue;
+                if (sampler) {
+                    sampler->add(row);
+                } else {
+                    selection.push_back(row);
+                }
+            }
+        }
+        aggregateSelection();
+    }
+
+    std::unique_ptr<QueryResult> finish() {
+        double scaling_factor = 1.0;
+        if (random || systematic || universe) {
+            scaling_factor = 1.0 / (random ? random->getSamplingRate() * plan.input_fraction
+                                    : systematic ? systematic->getSamplingRate() : universe->getSamplingRate());
+        } else if (sampler) {
+            plan.checkCancelled();
+            selection = sampler->getSample();
+            aggregateSelection();
+            double rate = sampler->getSamplingRate();
+            scaling_factor = rate > 0 ? 1.0 / rate : 1.0;
         }
+
+        auto result = makeResult(*plan.query);
+        addGroupRows(plan, groups.release(), scaling_factor, *result);
         return result;
     }
 
 private:
-    void setupSampling(const Sampling* sampling) {
-        if (!sampling || sampling->method == SamplingMethod::NONE) {
-            sampler.reset();
-            return;
+    bool accept(const DataRow* row) {
+        if (universe) return universe->accept(row);
+        return random ? random->accept() : systematic->accept();
+    }
+
+    void aggregateSelection() {
+        if (selection.empty()) return;
+        group_of.resize(selection.size());
+        for (size_t r = 0; r < selection.size(); ++r) {
+            group_of[r] = groups.find(*selection[r]);
+            ++groups.at(group_of[r]).row_count;
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            auto column = inputs[i].evaluate(selection);
+            for (size_t r = 0; r < selection.size(); ++r) {
+                if (column.valid[r]) groups.at(group_of[r]).inputs[i].addValue(column.values[r]);
+            }
         }
+    }
 
-        switch (sampling->method) {
-            case SamplingMethod::RANDOM:
-                sampler = std::make_unique<core::SimpleRandomSampling<DataRow>>(sampling->rate);
-                break;
-            case SamplingMethod::SYSTEMATIC:
-                 sampler = std::make_unique<core::SystematicSampling<DataRow>>(sampling->size);
-                 break;
+    // Samplers that must see every qualifying row before choosing. They hold
+    // pointers into the input rather than copies.
+    static std::unique_ptr<core::SamplingStrategy<const DataRow*>> createSampler(const Sampling& sampling) {
+        switch (sampling.method) {
             case SamplingMethod::RESERVOIR:
-                sampler = std::make_unique<core::ReservoirSample<DataRow>>(sampling->size);
-                break;
+                return std::make_unique<core::ReservoirSample<const DataRow*>>(sampling.size);
             case SamplingMethod::STRATIFIED: {
-                auto key_extractor = [strat_col = sampling->stratification_column](const DataRow& row) {
-                    if (row.values.count(strat_col)) {
-                        return row.values.at(strat_col);
-                    }
-                    return std::string("");
+                auto key_extractor = [strat_col = sampling.stratification_column](const DataRow* row) {
+                    auto it = row->values.find(strat_col);
+                    return it != row->values.end() ? it->second : std::string("");
                 };
-                sampler = std::make_unique<core::StratifiedSampling<DataRow, decltype(key_extractor)>>(sampling->rate, key_extractor);
-                break;
+                return std::make_unique<core::StratifiedSampling<const DataRow*, decltype(key_extractor)>>(
+                    sampling.rate, key_extractor);
             }
             default:
-                sampler.reset();
-                break;
+                return nullptr;
         }
     }
+};
 
-    void processRow(const Query& query, const DataRow& row) {
-        std::string group_key = "default";
-        std::vector<std::string> group_values;
-        if (!query.group_by_columns.empty()) {
-            std::stringstream ss;
-            for (const auto& group_col : query.group_by_columns) {
-                auto it = row.values.find(group_col);
-                if (it != row.values.end()) {
-                    ss << it->second << "|";
-                    group_values.push_back(it->second);
-                } else {
-                    ss << "NULL|";
-                    group_values.push_back("NULL"); 
-                }
+// Runs physical plans produced by Planner. Execution state lives on the stack
+// of execute(), so one executor may be reused across queries.
+class QueryExecutor {
+public:
+    // Rows handed to a scan pipeline at a time.
+    static constexpr size_t BATCH_SIZE = 4096;
+
+    QueryExecutor() {}
+
+    std::unique_ptr<QueryResult> execute(const Query& query, const RowSet& data) {
+        return execute(Planner().plan(query), data);
+    }
+
+    std::unique_ptr<QueryResult> execute(const PhysicalPlan& plan, const RowSet& data) {
+        if (plan.query->join) {
+            throw std::invalid_argument("Join queries are run with executeJoin()");
+        }
+        if (auto result = executeWithoutScan(plan)) {
+            return result;
+        }
+        if (plan.query->hasWindowFunctions()) {
+            auto result = makeResult(*plan.query);
+            for (auto& row : WindowOperator::run(*plan.query, data, plan.cancellation.get())) {
+                result->addRow(std::move(row));
             }
-            group_key = ss.str();
+            return result;
         }
+        QueryPipeline pipeline(plan);
+        data.forEachBatch(BATCH_SIZE, [&](const DataRow* begin, const DataRow* end) { pipeline.consume(begin, end); });
+        return pipeline.finish();
+    }
 
-        if (group_results.find(group_key) == group_results.end()) {
-            auto agg_result = std::make_unique<AggregateResult>();
-            for (const auto& col : query.columns) {
-                if (col.aggregation != AggregationType::NONE) {
-                    std::string column_key = col.alias.empty() ? col.name : col.alias;
-                    agg_result->addAggregator(column_key, col.aggregation);
-                }
-            }
-            agg_result->setGroupByValues(group_values);
-            group_results[group_key] = std::move(agg_result);
+    // Answers plans that do not read table rows (statistics, sketch and cube
+    // lookups). Returns nullptr for TABLE_SCAN plans.
+    static std::unique_ptr<QueryResult> executeWithoutScan(const PhysicalPlan& plan) {
+        const Query& query = *plan.query;
+        if (query.hasUnboundParameters()) {
+            throw std::invalid_argument("Query has unbound parameters");
         }
 
-        for (const auto& col : query.columns) {
-            if (col.aggregation != AggregationType::NONE) {
-                std::string column_key = col.alias.empty() ? col.name : col.alias;
-                if (col.aggregation == AggregationType::COUNT) {
-                    group_results[group_key]->addValue(column_key, 1.0);
-                } else {
-                    auto value_it = row.values.find(col.name);
-                    if (value_it != row.values.end() && !value_it->second.empty()) {
-                        try {
-                            double value = std::stod(value_it->second);
-                            group_results[group_key]->addValue(column_key, value);
-                        } catch (const std::exception& e) { 
-                            // std::cerr << "Warning: Skipping non-numeric value '" << value_it->second << "'\n";
-                        }
-                    }
-                }
-            }
+        if (plan.access == AccessPath::STATISTICS_LOOKUP || plan.access == AccessPath::SKETCH_LOOKUP) {
+            // COUNT(*)-only plans: a single group whose row count is the answer
+            auto result = makeResult(query);
+            GroupAggregates group;
+            group.row_count = plan.access == AccessPath::STATISTICS_LOOKUP
+                ? plan.statistics->row_count
+                : static_cast<size_t>(plan.statistics->column(query.where->column)
+                      ->frequencies->estimate(std::get<std::string>(query.where->value)));
+            addGroupRows(plan, {group}, 1.0, *result);
+            return result;
+        }
+
+        if (plan.access == AccessPath::CUBE_LOOKUP) {
+            auto result = makeResult(query);
+            result->setApproximate(false);
+            addGroupRows(plan, plan.cube->rollUp(query, plan.input_columns), 1.0, *result);
+            return result;
         }
+        return nullptr;
     }
 };
 
 } // namespace query
-} // namespace aqe
\ No newline at end of file
+} // namespace aqe
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <charconv>
+
+namespace aqe {
+namespace query {
+
+// Arithmetic expression over numeric columns, as written inside an
+// aggregate: `SUM(price * qty)`, `AVG(value / 100.0)`.
+struct Expression {
+    enum class Kind { COLUMN, NUMBER, ADD, SUBTRACT, MULTIPLY, DIVIDE, NEGATE };
+
+    Kind kind = Kind::NUMBER;
+    std::string column;
+    double number = 0.0;
+    std::vector<Expression> operands;
+    size_t position = 0;
+
+    static Expression makeColumn(const std::string& name, size_t pos) {
+        Expression e;
+        e.kind = Kind::COLUMN;
+        e.column = name;
+        e.position = pos;
+        return e;
+    }
+
+    static Expression makeNumber(double value, size_t pos) {
+        Expression e;
+        e.kind = Kind::NUMBER;
+        e.number = value;
+        e.position = pos;
+        return e;
+    }
+
+    static Expression makeOperation(Kind kind, std::vector<Expression> operands, size_t pos) {
+        Expression e;
+        e.kind = kind;
+        e.operands = std::move(operands);
+        e.position = pos;
+        return e;
+    }
+
+    bool isColumn() const { return kind == Kind::COLUMN; }
+
+    // Canonical spelling with single spaces around operators and only the
+    // parentheses precedence requires. Equal expressions print equally, which
+    // is what lets aggregates over the same expression share an input.
+    std::string toString() const {
+        switch (kind) {
+            case Kind::COLUMN:
+                return column;
+            case Kind::NUMBER: {
+                char buffer[32];
+                auto [ptr, ec] = std::to_chars(buffer, buffer + sizeof(buffer), number);
+                return std::string(buffer, ptr);
+            }
+            case Kind::NEGATE:
+                return "-" + operandString(operands[0], true);
+            default:
+                return operandString(operands[0], false) + " " + symbol() + " " +
+                       operandString(operands[1], true);
+        }
+    }
+
+private:
+    int precedence() const {
+        switch (kind) {
+            case Kind::ADD:
+            case Kind::SUBTRACT:
+                return 1;
+            case Kind::MULTIPLY:
+            case Kind::DIVIDE:
+                return 2;
+            default:
+                return 3;
+        }
+    }
+
+    const char* symbol() const {
+        switch (kind) {
+            case Kind::ADD: return "+";
+            case Kind::SUBTRACT: return "-";
+            case Kind::MULTIPLY: return "*";
+            case Kind::DIVIDE: return "/";
+            default: return "";
+        }
+    }
+
+    // Operators are left-associative, so a right operand of equal precedence
+    // keeps its parentheses: a - (b - c).
+    std::string operandString(const Expression& operand, bool right) const {
+        std::string text = operand.toString();
+        bool needs_parens = operand.precedence() < precedence() ||
+                            (right && operand.precedence() == precedence() && kind != Kind::NEGATE);
+        return needs_parens ? "(" + text + ")" : text;
+    }
+};
+
+} // namespace query
+} // namespace aqe
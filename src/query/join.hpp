@@ -0,0 +1,129 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <stdexcept>
+#include <algorithm>
+#include "data_row.hpp"
+#include "parser.hpp"
+#include "executor.hpp"
+#include "planner.hpp"
+#include "../core/sketching.hpp"
+
+namespace aqe {
+namespace query {
+
+// Hash join of a probe table against a build table on one equality key. The
+// build side is indexed once; its keys also populate a Bloom filter that the
+// probe scan checks first, so probe rows with no possible match are dropped
+// before hashing their key or touching the hash table. Rows missing the join
+// key never match.
+//
+// Under UNIVERSE sampling both sides keep only the keys the universe hash
+// selects, so unselected build rows are never indexed and unselected probe
+// rows are dropped before the Bloom filter.
+class HashJoin {
+public:
+    // Bloom filter bits per distinct build key; with three hash functions
+    // this keeps false positives around 2%.
+    static constexpr size_t BLOOM_BITS_PER_KEY = 10;
+
+    HashJoin(const JoinClause& join_clause, const RowSet& build_rows,
+             const Sampling& sampling = Sampling())
+        : clause(join_clause), runtime_filter(1) {
+        if (sampling.method == SamplingMethod::UNIVERSE) {
+            universe = std::make_unique<UniverseSampler>(sampling.rate, ColumnKey{clause.probe_column});
+        }
+        build_rows.forEachRow([&](const DataRow& row) {
+            auto it = row.values.find(clause.build_column);
+            if (it == row.values.end() || (universe && !universe->acceptKey(it->second))) return;
+            table[it->second].push_back(&row);
+        });
+        runtime_filter = core::BloomFilter(std::max<size_t>(64, table.size() * BLOOM_BITS_PER_KEY));
+        for (const auto& entry : table) {
+            runtime_filter.add(entry.first);
+        }
+    }
+
+    // Appends the join output for probe rows [begin, end) to `out`.
+    template <typename Output>
+    void probe(const DataRow* begin, const DataRow* end, Output& out) {
+        for (const DataRow* row = begin; row != end; ++row) {
+            auto key = row->values.find(clause.probe_column);
+            if (key == row->values.end()) continue;
+            if (universe && !universe->acceptKey(key->second)) continue;
+            if (!runtime_filter.mightContain(key->second)) {
+                ++filtered_rows;
+                continue;
+            }
+            auto match = table.find(key->second);
+            if (match == table.end()) continue;
+
+            if (clause.type == JoinType::SEMI) {
+                out.push_back(*row);
+                continue;
+            }
+            for (const DataRow* build : match->second) {
+                DataRow joined = *row;
+                for (const auto& value : build->values) {
+                    joined.values.emplace(value.first, value.second);
+                }
+                out.push_back(std::move(joined));
+            }
+        }
+    }
+
+    size_t buildKeys() const { return table.size(); }
+    // Probe rows rejected by the runtime filter without a hash table lookup.
+    size_t filteredRows() const { return filtered_rows; }
+
+private:
+    const JoinClause& clause;
+    std::unordered_map<std::string, std::vector<const DataRow*>> table;
+    core::BloomFilter runtime_filter;
+    std::unique_ptr<UniverseSampler> universe;
+    size_t filtered_rows = 0;
+};
+
+// Runs a TABLE_SCAN plan whose query joins `probe_data` (the FROM table) with
+// `build_data` (the JOIN table). Joined rows are produced a probe batch at a
+// time and fed to the query pipeline; they are only kept for the whole query
+// when a reservoir or stratified sample needs them until finish().
+inline std::unique_ptr<QueryResult> executeJoin(const PhysicalPlan& plan, const RowSet& probe_data,
+                                                const RowSet& build_data) {
+    const Query& query = *plan.query;
+    if (!query.join) {
+        throw std::invalid_argument("Query has no JOIN clause");
+    }
+    QueryPipeline pipeline(plan);
+    plan.checkCancelled();
+    HashJoin join(*query.join, build_data, query.sampling);
+
+    SamplingMethod method = query.sampling.method;
+    bool retain = method == SamplingMethod::RESERVOIR || method == SamplingMethod::STRATIFIED;
+    std::deque<DataRow> retained;
+    std::vector<DataRow> batch;
+
+    probe_data.forEachBatch(QueryExecutor::BATCH_SIZE, [&](const DataRow* begin, const DataRow* end) {
+        plan.checkCancelled();
+        batch.clear();
+        join.probe(begin, end, batch);
+        if (retain) {
+            // Samplers keep pointers into their input, which must stay put
+            for (auto& row : batch) retained.push_back(std::move(row));
+            auto first = retained.end() - static_cast<std::ptrdiff_t>(batch.size());
+            for (auto it = first; it != retained.end(); ++it) {
+                pipeline.consume(&*it, &*it + 1);
+            }
+        } else {
+            pipeline.consume(batch.data(), batch.data() + batch.size());
+        }
+    });
+    return pipeline.finish();
+}
+
+} // namespace query
+} // namespace aqe
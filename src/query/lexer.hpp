@@ -0,0 +1,162 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <stdexcept>
+#include <cctype>
+
+namespace aqe {
+namespace query {
+
+enum class TokenType { IDENTIFIER, KEYWORD, NUMBER, STRING, SYMBOL, END };
+
+// A single lexical token. Keywords are stored upper-cased in `text`; every
+// other token keeps its source spelling. `position` is the byte offset of the
+// first character of the token in the original query string.
+struct Token {
+    TokenType type;
+    std::string text;
+    size_t position;
+
+    bool is(TokenType t, std::string_view s) const { return type == t && text == s; }
+    bool isKeyword(std::string_view kw) const { return is(TokenType::KEYWORD, kw); }
+    bool isSymbol(std::string_view sym) const { return is(TokenType::SYMBOL, sym); }
+};
+
+class LexError : public std::runtime_error {
+private:
+    size_t pos;
+
+public:
+    LexError(const std::string& message, size_t position)
+        : std::runtime_error(message + " at position " + std::to_string(position)), pos(position) {}
+    size_t position() const { return pos; }
+};
+
+// Single-pass tokenizer for the query language. Keyword recognition is
+// case-insensitive and only applies to whole identifiers, so a column named
+// `sampled_from` never matches SAMPLE or FROM.
+class Lexer {
+public:
+    static std::vector<Token> tokenize(std::string_view input) {
+        std::vector<Token> tokens;
+        size_t i = 0;
+        const size_t n = input.size();
+
+        while (i < n) {
+            char c = input[i];
+            if (std::isspace(static_cast<unsigned char>(c))) {
+                ++i;
+                continue;
+            }
+
+            size_t start = i;
+            if (std::isalpha(static_cast<unsigned char>(c)) || c == '_') {
+                while (i < n && (std::isalnum(static_cast<unsigned char>(input[i])) || input[i] == '_')) {
+                    ++i;
+                }
+                std::string word(input.substr(start, i - start));
+                std::string upper = toUpperAscii(word);
+                if (isKeyword(upper)) {
+                    tokens.push_back({TokenType::KEYWORD, std::move(upper), start});
+                } else {
+                    tokens.push_back({TokenType::IDENTIFIER, std::move(word), start});
+                }
+            } else if (startsNumber(input, i) || (c == '-' && !followsOperand(tokens) && startsNumber(input, i + 1))) {
+                if (c == '-') ++i;
+                bool seen_dot = false;
+                while (i < n && (std::isdigit(static_cast<unsigned char>(input[i])) || (input[i] == '.' && !seen_dot))) {
+                    if (input[i] == '.') seen_dot = true;
+                    ++i;
+                }
+                tokens.push_back({TokenType::NUMBER, std::string(input.substr(start, i - start)), start});
+            } else if (c == '\'') {
+                std::string value;
+                ++i;
+                bool closed = false;
+                while (i < n) {
+                    if (input[i] == '\'') {
+                        // '' inside a string literal is an escaped quote
+                        if (i + 1 < n && input[i + 1] == '\'') {
+                            value.push_back('\'');
+                            i += 2;
+                            continue;
+                        }
+                        closed = true;
+                        ++i;
+                        break;
+                    }
+                    value.push_back(input[i++]);
+                }
+                if (!closed) {
+                    throw LexError("Unterminated string literal", start);
+                }
+                tokens.push_back({TokenType::STRING, std::move(value), start});
+            } else {
+                static constexpr std::string_view two_char_ops[] = {"<=", ">=", "!=", "<>"};
+                bool matched = false;
+                for (auto op : two_char_ops) {
+                    if (input.substr(i, 2) == op) {
+                        tokens.push_back({TokenType::SYMBOL, std::string(op), start});
+                        i += 2;
+                        matched = true;
+                        break;
+                    }
+                }
+                if (!matched) {
+                    static constexpr std::string_view single_char_ops = "(),*%.;=<>+-/?";
+                    if (single_char_ops.find(c) == std::string_view::npos) {
+                        throw LexError(std::string("Unexpected character '") + c + "'", start);
+                    }
+                    tokens.push_back({TokenType::SYMBOL, std::string(1, c), start});
+                    ++i;
+                }
+            }
+        }
+
+        tokens.push_back({TokenType::END, "", n});
+        return tokens;
+    }
+
+    static bool isKeyword(std::string_view upper) {
+        static constexpr std::string_view keywords[] = {
+            "SELECT", "FROM", "WHERE", "GROUP", "BY", "HAVING", "SAMPLE", "AS",
+            "AND", "OR", "ORDER", "LIMIT", "ASC", "DESC",
+            "RESERVOIR", "SYSTEMATIC", "STRATIFIED", "UNIVERSE", "JOIN", "INNER", "SEMI", "ON",
+            "OVER", "PARTITION", "ROWS", "PRECEDING"
+        };
+        for (auto kw : keywords) {
+            if (kw == upper) return true;
+        }
+        return false;
+    }
+
+private:
+    static bool startsNumber(std::string_view input, size_t i) {
+        if (i >= input.size()) return false;
+        if (std::isdigit(static_cast<unsigned char>(input[i]))) return true;
+        return input[i] == '.' && i + 1 < input.size() &&
+               std::isdigit(static_cast<unsigned char>(input[i + 1]));
+    }
+
+    // A '-' directly after an operand is binary minus; anywhere else it is
+    // folded into the numeric literal that follows it.
+    static bool followsOperand(const std::vector<Token>& tokens) {
+        if (tokens.empty()) return false;
+        const Token& prev = tokens.back();
+        return prev.type == TokenType::IDENTIFIER || prev.type == TokenType::NUMBER ||
+               prev.type == TokenType::STRING || prev.isSymbol(")") || prev.isSymbol("?");
+    }
+
+    static std::string toUpperAscii(const std::string& s) {
+        std::string out = s;
+        for (auto& ch : out) {
+            ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+        }
+        return out;
+    }
+};
+
+} // namespace query
+} // namespace aqe
@@ -5,201 +5,882 @@
 #include <unordered_map>
 #include <memory>
 #include <stdexcept>
-#include <regex>
-#include <sstream>
-#include "../utils/string_utils.hpp"   
+#include <variant>
+#include <optional>
+#include <cmath>
+#include <cctype>
+#include <limits>
+#include <cstdlib>
+#include "lexer.hpp"
+#include "expression.hpp"
+#include "../utils/string_utils.hpp"
 
 namespace aqe {
 namespace query {
 
 class ParseError : public std::runtime_error {
+private:
+    size_t pos;
+
 public:
-    explicit ParseError(const std::string& message) : std::runtime_error(message) {}
+    static constexpr size_t NO_POSITION = static_cast<size_t>(-1);
+
+    explicit ParseError(const std::string& message, size_t position = NO_POSITION)
+        : std::runtime_error(message), pos(position) {}
+    size_t position() const { return pos; }
 };
 
-// ... (Enums and Structs are the same) ...
 enum class AggregationType { COUNT, SUM, AVG, MIN, MAX, NONE };
-enum class SamplingMethod { NONE, RANDOM, SYSTEMATIC, RESERVOIR, STRATIFIED };
+enum class SamplingMethod { NONE, RANDOM, SYSTEMATIC, RESERVOIR, STRATIFIED, UNIVERSE };
 
-    struct Column {
-        std::string name;
-        std::string alias;
-        AggregationType aggregation;
-        bool is_star;
+// A literal value bound to a `?` placeholder.
+using Value = std::variant<double, std::string>;
 
-        Column(const std::string& n, const std::string& a = "", 
-            AggregationType agg = AggregationType::NONE)
-            : name(n), alias(a), aggregation(agg), is_star(n == "*") {}
-    };
+// Where the value bound to a placeholder ends up in the parsed query.
+enum class ParameterTarget { SAMPLE_PERCENT, SAMPLE_SIZE, WHERE_VALUE, HAVING_VALUE, LIMIT };
 
-    struct Sampling {
-        SamplingMethod method;
-        double rate;
-        size_t size;
-        std::string stratification_column;
+struct ParameterSlot {
+    ParameterTarget target;
+    size_t position;
+    bool bound = false;
+};
 
-        Sampling() : method(SamplingMethod::NONE), rate(1.0), size(0) {}
+enum class WindowFunction { ROW_NUMBER, COUNT, SUM, AVG, MIN, MAX };
 
-        void validate() const {
-            if (method == SamplingMethod::RANDOM && (rate <= 0.0 || rate > 1.0)) {
-                throw ParseError("Sampling rate must be between 0 and 1");
-            }
-            if (method == SamplingMethod::RESERVOIR && size == 0) {
-                throw ParseError("Reservoir sample size must be greater than 0");
-            }
+struct WindowOrder {
+    std::string column;
+    bool descending = false;
+};
+
+// `func(arg) OVER ([PARTITION BY ...] [ORDER BY ...] [ROWS n PRECEDING])`.
+// Without a frame the function runs over the partition up to and including
+// the current row; ROWS n PRECEDING limits it to the n rows before it. Rows
+// tied on the ORDER BY keys are still counted one at a time.
+struct WindowSpec {
+    WindowFunction function = WindowFunction::ROW_NUMBER;
+    std::vector<std::string> partition_by;
+    std::vector<WindowOrder> order_by;
+    std::optional<size_t> preceding;
+};
+
+// A select item. For an aggregate over an arithmetic expression `name` is
+// the expression's canonical text and `expression` holds its tree; plain
+// columns and `*` leave `expression` empty. A window function column has
+// aggregation NONE, its argument column (or `*`) as `name`, and `window` set.
+struct Column {
+    std::string name;
+    std::string alias;
+    AggregationType aggregation;
+    bool is_star;
+    size_t position = 0;
+    std::shared_ptr<const Expression> expression;
+    std::shared_ptr<const WindowSpec> window;
+
+    Column(const std::string& n, const std::string& a = "",
+        AggregationType agg = AggregationType::NONE)
+        : name(n), alias(a), aggregation(agg), is_star(n == "*") {}
+};
+
+struct Sampling {
+    SamplingMethod method;
+    double rate;
+    size_t size;
+    std::string stratification_column;
+    std::string universe_column; // key hashed by UNIVERSE sampling
+    size_t position = 0;
+
+    Sampling() : method(SamplingMethod::NONE), rate(1.0), size(0) {}
+
+    void validate() const {
+        if (method == SamplingMethod::RANDOM && (rate <= 0.0 || rate > 1.0)) {
+            throw ParseError("Sampling rate must be between 0 and 1", position);
+        }
+        if ((method == SamplingMethod::STRATIFIED || method == SamplingMethod::UNIVERSE) &&
+            (rate <= 0.0 || rate > 1.0)) {
+            throw ParseError("Sampling rate must be between 0 and 1", position);
+        }
+        if (method == SamplingMethod::RESERVOIR && size == 0) {
+            throw ParseError("Reservoir sample size must be greater than 0", position);
+        }
+        if (method == SamplingMethod::SYSTEMATIC && size == 0) {
+            throw ParseError("Systematic step size must be greater than 0", position);
+        }
+    }
+};
+
+enum class CompareOp { EQ, NE, LT, LE, GT, GE };
+
+// WHERE or HAVING clause node: either a `column op literal` comparison or an
+// AND/OR over child predicates. HAVING comparisons refer to an output column
+// of the query through `output_index`; WHERE comparisons leave it at -1.
+struct Predicate {
+    enum class Kind { COMPARISON, AND, OR };
+
+    Kind kind = Kind::COMPARISON;
+    std::string column;
+    CompareOp op = CompareOp::EQ;
+    Value value;
+    long parameter_index = -1; // index into Query::parameters, -1 for a literal
+    long output_index = -1;
+    size_t position = 0;
+    std::vector<Predicate> children;
+
+    // Finds the comparison whose value comes from placeholder `index`.
+    Predicate* findParameter(size_t index) {
+        if (kind == Kind::COMPARISON) {
+            return parameter_index == static_cast<long>(index) ? this : nullptr;
+        }
+        for (auto& child : children) {
+            if (Predicate* found = child.findParameter(index)) return found;
+        }
+        return nullptr;
+    }
+};
+
+// ORDER BY item, resolved at parse time to an output column.
+struct OrderItem {
+    size_t column_index;
+    bool descending = false;
+    size_t position = 0;
+};
+
+enum class JoinType { INNER, SEMI };
+
+// `FROM probe [INNER | SEMI] JOIN build ON probe_column = build_column`.
+// An inner join yields each probe row merged with every matching build row
+// (probe values win on name clashes); a semi join yields each probe row that
+// has at least one match, once.
+struct JoinClause {
+    JoinType type = JoinType::INNER;
+    std::string table;
+    std::string probe_column;
+    std::string build_column;
+    size_t position = 0;
+};
+
+// The value of a NUMBER token. Literals beyond the range of a double become
+// infinity instead of throwing std::out_of_range, so callers report them.
+inline double numberLiteral(const std::string& text) {
+    return std::strtod(text.c_str(), nullptr);
+}
+
+// A numeric literal used as a row count or step size. Throws ParseError
+// unless it is a non-negative integer that fits in a size_t.
+inline size_t countFromLiteral(double number, const std::string& what, size_t position) {
+    if (!(number >= 0) || std::floor(number) != number ||
+        number >= std::ldexp(1.0, std::numeric_limits<size_t>::digits)) {
+        throw ParseError(what + " must be a non-negative integer", position);
+    }
+    return static_cast<size_t>(number);
+}
+
+// Root of the parsed query tree.
+class Query {
+public:
+    std::vector<Column> columns;
+    std::string table_name;
+    std::optional<JoinClause> join;
+    std::optional<Predicate> where;
+    std::vector<std::string> group_by_columns;
+    std::optional<Predicate> having;
+    Sampling sampling;
+    std::vector<OrderItem> order_by;
+    std::optional<size_t> limit;
+    std::vector<ParameterSlot> parameters;
+    size_t table_position = 0;
+
+    bool hasWindowFunctions() const {
+        for (const auto& col : columns) {
+            if (col.window) return true;
         }
-    };
+        return false;
+    }
 
-    class Query {
-    public:
-        std::vector<Column> columns;
-        std::string table_name;
-        std::vector<std::string> group_by_columns;
-        Sampling sampling;
- 
+    bool hasUnboundParameters() const {
+        for (const auto& slot : parameters) {
+            if (!slot.bound) return true;
+        }
+        return false;
+    }
 
-        void validate() const {
-            if (table_name.empty()) {
-                throw ParseError("Table name cannot be empty");
+    // Assigns a value to the placeholder at `index` (in source order). Once
+    // every placeholder is bound the literal-dependent checks are re-run.
+    void bindParameter(size_t index, const Value& value) {
+        if (index >= parameters.size()) {
+            throw ParseError("Parameter index " + std::to_string(index) + " out of range");
+        }
+        ParameterSlot& slot = parameters[index];
+        if (slot.target == ParameterTarget::WHERE_VALUE || slot.target == ParameterTarget::HAVING_VALUE) {
+            auto& clause = slot.target == ParameterTarget::WHERE_VALUE ? where : having;
+            Predicate* comparison = clause ? clause->findParameter(index) : nullptr;
+            if (!comparison) {
+                throw ParseError("No comparison for parameter " + std::to_string(index));
             }
-             
-            bool has_aggregation = false;
-            bool has_non_agg_column = false;
+            comparison->value = value;
+            slot.bound = true;
+            return;
+        }
+        const double* number = std::get_if<double>(&value);
+        if (!number) {
+            throw ParseError("Parameter at position " + std::to_string(slot.position) +
+                             " expects a numeric value", slot.position);
+        }
+        auto as_count = [&]() {
+            return countFromLiteral(*number, "Parameter at position " + std::to_string(slot.position), slot.position);
+        };
+        switch (slot.target) {
+            case ParameterTarget::SAMPLE_PERCENT:
+                sampling.rate = *number / 100.0;
+                break;
+            case ParameterTarget::WHERE_VALUE:
+            case ParameterTarget::HAVING_VALUE:
+                break;
+            case ParameterTarget::SAMPLE_SIZE:
+                sampling.size = as_count();
+                break;
+            case ParameterTarget::LIMIT:
+                limit = as_count();
+                break;
+        }
+        slot.bound = true;
+        if (!hasUnboundParameters()) {
+            sampling.validate();
+        }
+    }
+
+    void validate() const {
+        validateStructure();
+        sampling.validate();
+    }
+
+    // Checks that do not depend on literal values, so they can run on a
+    // query template that still has unbound placeholders.
+    void validateStructure() const {
+        if (table_name.empty()) {
+            throw ParseError("Table name cannot be empty", table_position);
+        }
+
+        if (hasWindowFunctions()) {
             for (const auto& col : columns) {
-                if (col.aggregation != AggregationType::NONE) {
-                    has_aggregation = true;
-                } else if (col.name != "*") {
-                    has_non_agg_column = true;
+                if (col.aggregation != AggregationType::NONE || (col.is_star && !col.window)) {
+                    throw ParseError("Window functions cannot be combined with aggregates or '*'", col.position);
                 }
             }
-            if (has_non_agg_column && has_aggregation && group_by_columns.empty()) {
-                throw ParseError("Queries with both aggregated and non-aggregated columns require a GROUP BY clause.");
-            } 
-            sampling.validate();
+            if (!group_by_columns.empty() || having) {
+                throw ParseError("Window functions cannot be combined with GROUP BY or HAVING");
+            }
+            if (sampling.method != SamplingMethod::NONE) {
+                throw ParseError("Window functions cannot be combined with SAMPLE", sampling.position);
+            }
+            return;
+        }
+
+        bool has_aggregation = false;
+        bool has_non_agg_column = false;
+        for (const auto& col : columns) {
+            if (col.aggregation != AggregationType::NONE) {
+                has_aggregation = true;
+            } else if (col.name != "*") {
+                has_non_agg_column = true;
+            }
         }
-    };
-    class QueryParser {
-        public:
-            QueryParser() {}
+        if (has_non_agg_column && has_aggregation && group_by_columns.empty()) {
+            throw ParseError("Queries with both aggregated and non-aggregated columns require a GROUP BY clause.");
+        }
+    }
+};
 
-            std::unique_ptr<Query> parse(const std::string& query_str) {
-                auto query = std::make_unique<Query>();
-                try {
-                    std::string upper_query = aqe::utils::toUpper(query_str);
-                    size_t select_pos = findKeyword(upper_query, "SELECT");
-                    size_t from_pos = findKeyword(upper_query, "FROM");
+// Recursive-descent parser over the token stream produced by Lexer.
+//
+//   query      := SELECT select_list FROM ident [join] [WHERE or_cond]
+//                 [GROUP BY ident_list] [HAVING or_cond] [SAMPLE sample]
+//                 [ORDER BY order_item (',' order_item)*] [LIMIT num] [SAMPLE sample] [;]
+//   select_item:= agg_func '(' ('*' | expr) ')' [AS ident] | window [AS ident]
+//               | '*' | ident [AS ident]
+//   window     := (ROW_NUMBER '(' ')' | agg_func '(' ('*' | ident) ')') OVER '('
+//                 [PARTITION BY ident_list] [ORDER BY ident [ASC | DESC] (',' ...)*]
+//                 [ROWS number PRECEDING] ')'
+//   join       := [INNER | SEMI] JOIN ident ON column_ref '=' column_ref
+//   column_ref := [ident '.'] ident
+//   output_ref := ident | agg_func '(' ('*' | expr) ')'
+//   expr       := term (('+' | '-') term)*
+//   term       := factor (('*' | '/') factor)*
+//   factor     := number | ident | '(' expr ')' | '-' factor
+//   order_item := (output_ref | number) [ASC | DESC]
+//   or_cond    := and_cond (OR and_cond)*
+//   and_cond   := cond_term (AND cond_term)*
+//   cond_term  := '(' or_cond ')' | operand cmp_op (number | string | '?')
+//
+// WHERE operands are table columns; HAVING and ORDER BY operands are
+// output_refs resolved against the select list.
+//   sample     := num '%' | RESERVOIR num | SYSTEMATIC num
+//               | STRATIFIED BY ident num '%' | UNIVERSE [BY ident] num '%'
+//   num        := number | '?'
+//
+// A `?` in place of a literal becomes an entry in Query::parameters; such a
+// query only has its literal-dependent checks run once every slot is bound.
+class QueryParser {
+public:
+    QueryParser() {}
 
-                    std::string select_clause = query_str.substr(select_pos + 6, from_pos - (select_pos + 6));
-                    parseColumns(query.get(), select_clause);
+    std::unique_ptr<Query> parse(const std::string& query_str) {
+        try {
+            return parseTokens(Lexer::tokenize(query_str));
+        } catch (const LexError& e) {
+            throw ParseError(std::string("Failed to parse query: ") + e.what(), e.position());
+        }
+    }
 
-                    std::string rest_of_query = query_str.substr(from_pos + 4);
-                    parseFromAndOtherClauses(query.get(), rest_of_query);
+    std::unique_ptr<Query> parse(std::vector<Token> query_tokens) {
+        return parseTokens(std::move(query_tokens));
+    }
 
-                    query->validate();
-                    return query;
-                } catch (const std::exception& e) {
-                    throw ParseError(std::string("Failed to parse query: ") + e.what());
-                }
+private:
+    std::vector<Token> tokens;
+    size_t current = 0;
+    Query* target = nullptr;
+
+    std::unique_ptr<Query> parseTokens(std::vector<Token> query_tokens) {
+        try {
+            tokens = std::move(query_tokens);
+            current = 0;
+            auto query = parseQuery();
+            query->validateStructure();
+            if (query->parameters.empty()) {
+                query->sampling.validate();
             }
+            return query;
+        } catch (const ParseError& e) {
+            throw ParseError(std::string("Failed to parse query: ") + e.what(), e.position());
+        }
+    }
 
-        private: 
-            void parseColumns(Query* query, const std::string& columns_str) {
-                std::stringstream ss(columns_str);
-                std::string part;
-                while(std::getline(ss, part, ',')) {
-                    std::string column_str = aqe::utils::trim(part);
-                    if (column_str.empty()) continue;
-
-                    static const std::regex agg_regex(R"((COUNT|SUM|AVG|MIN|MAX)\s*\(([^)]+)\)(?:\s+AS\s+([\w]+))?)", std::regex::icase);
-                    std::smatch matches;
-
-                    if (std::regex_match(column_str, matches, agg_regex)) {
-                        std::string func = aqe::utils::toUpper(matches[1].str());
-                        std::string inner_col = aqe::utils::trim(matches[2].str());
-                        std::string alias = matches[3].matched ? matches[3].str() : "";
-
-                        if (alias.empty()) {
-                            alias = func + "(" + aqe::utils::toUpper(inner_col) + ")";
-                        }
-
-                        AggregationType agg_type = AggregationType::NONE;
-                        if (func == "COUNT") agg_type = AggregationType::COUNT;
-                        else if (func == "SUM") agg_type = AggregationType::SUM;
-                        else if (func == "AVG") agg_type = AggregationType::AVG;
-                        else if (func == "MIN") agg_type = AggregationType::MIN;
-                        else if (func == "MAX") agg_type = AggregationType::MAX;
-                        
-                        query->columns.emplace_back(inner_col, alias, agg_type);
-                    } else {
-                        query->columns.emplace_back(column_str);
-                    }
-                }
+    const Token& peek() const { return tokens[current]; }
+    const Token& advance() { return tokens[current < tokens.size() - 1 ? current++ : current]; }
+
+    bool matchKeyword(const char* kw) {
+        if (peek().isKeyword(kw)) {
+            advance();
+            return true;
+        }
+        return false;
+    }
+
+    bool matchSymbol(const char* sym) {
+        if (peek().isSymbol(sym)) {
+            advance();
+            return true;
+        }
+        return false;
+    }
+
+    [[noreturn]] void fail(const std::string& expected) const {
+        const Token& tok = peek();
+        std::string found = tok.type == TokenType::END ? "end of query" : "'" + tok.text + "'";
+        throw ParseError("Expected " + expected + " but found " + found +
+                         " at position " + std::to_string(tok.position), tok.position);
+    }
+
+    void expectKeyword(const char* kw) {
+        if (!matchKeyword(kw)) fail(kw);
+    }
+
+    void expectSymbol(const char* sym) {
+        if (!matchSymbol(sym)) fail(std::string("'") + sym + "'");
+    }
+
+    const Token& expectIdentifier(const char* what) {
+        if (peek().type != TokenType::IDENTIFIER) fail(what);
+        return advance();
+    }
+
+    const Token& expectNumber(const char* what) {
+        if (peek().type != TokenType::NUMBER) fail(what);
+        return advance();
+    }
+
+    // Parses a numeric literal, or records a placeholder and returns 0.
+    double parseNumberOrParameter(const char* what, ParameterTarget slot_target) {
+        if (peek().isSymbol("?")) {
+            target->parameters.push_back({slot_target, advance().position});
+            return 0.0;
+        }
+        return numberLiteral(expectNumber(what).text);
+    }
+
+    size_t parseCountOrParameter(const char* what, ParameterTarget slot_target) {
+        size_t position = peek().position;
+        std::string description = what;
+        description[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(description[0])));
+        return countFromLiteral(parseNumberOrParameter(what, slot_target), description, position);
+    }
+
+    std::unique_ptr<Query> parseQuery() {
+        auto query = std::make_unique<Query>();
+        target = query.get();
+        expectKeyword("SELECT");
+        parseSelectList(*query);
+        expectKeyword("FROM");
+        const Token& table = expectIdentifier("table name");
+        query->table_name = table.text;
+        query->table_position = table.position;
+
+        if (peek().isKeyword("JOIN") || peek().isKeyword("INNER") || peek().isKeyword("SEMI")) {
+            query->join = parseJoin(*query);
+        }
+        if (matchKeyword("WHERE")) {
+            query->where = parseOrCondition(false);
+        }
+        if (matchKeyword("GROUP")) {
+            expectKeyword("BY");
+            parseGroupBy(*query);
+        }
+        if (matchKeyword("HAVING")) {
+            query->having = parseOrCondition(true);
+        }
+        bool sampled = false;
+        if (peek().isKeyword("SAMPLE")) {
+            parseSampling(*query);
+            sampled = true;
+        }
+        if (matchKeyword("ORDER")) {
+            expectKeyword("BY");
+            parseOrderBy(*query);
+        }
+        if (matchKeyword("LIMIT")) {
+            query->limit = parseCountOrParameter("LIMIT row count", ParameterTarget::LIMIT);
+        }
+        if (!sampled && peek().isKeyword("SAMPLE")) {
+            parseSampling(*query);
+        }
+        matchSymbol(";");
+        if (peek().type != TokenType::END) fail("end of query");
+        return query;
+    }
+
+    JoinClause parseJoin(const Query& query) {
+        JoinClause join;
+        join.position = peek().position;
+        if (matchKeyword("SEMI")) {
+            join.type = JoinType::SEMI;
+        } else {
+            matchKeyword("INNER");
+        }
+        expectKeyword("JOIN");
+        join.table = expectIdentifier("joined table name").text;
+        if (join.table == query.table_name) {
+            throw ParseError("Self-joins are not supported", join.position);
+        }
+        expectKeyword("ON");
+
+        // Each side of the condition is qualified by a table name or, if
+        // unqualified, taken in FROM-table = JOIN-table order.
+        std::string left_table, right_table;
+        std::string left = parseColumnReference(left_table);
+        expectSymbol("=");
+        std::string right = parseColumnReference(right_table);
+        bool swapped = left_table == join.table || right_table == query.table_name;
+        for (const std::string* t : {&left_table, &right_table}) {
+            if (!t->empty() && *t != query.table_name && *t != join.table) {
+                throw ParseError("Unknown table '" + *t + "' in join condition", join.position);
             }
- 
-            void parseFromAndOtherClauses(Query* query, const std::string& rest_str) {
-                std::string upper_rest = aqe::utils::toUpper(rest_str);
-                size_t group_by_pos = upper_rest.find("GROUP BY");
-                size_t sample_pos = upper_rest.find("SAMPLE");
+        }
+        if (!left_table.empty() && left_table == right_table) {
+            throw ParseError("Join condition must compare columns of both tables", join.position);
+        }
+        join.probe_column = swapped ? right : left;
+        join.build_column = swapped ? left : right;
+        return join;
+    }
+
+    std::string parseColumnReference(std::string& table) {
+        std::string name = expectIdentifier("column name").text;
+        if (matchSymbol(".")) {
+            table = name;
+            return expectIdentifier("column name").text;
+        }
+        return name;
+    }
+
+    void parseSelectList(Query& query) {
+        do {
+            query.columns.push_back(parseSelectItem());
+        } while (matchSymbol(","));
+    }
+
+    static AggregationType aggregationFromName(const std::string& name) {
+        std::string func = aqe::utils::toUpper(name);
+        if (func == "COUNT") return AggregationType::COUNT;
+        if (func == "SUM") return AggregationType::SUM;
+        if (func == "AVG") return AggregationType::AVG;
+        if (func == "MIN") return AggregationType::MIN;
+        if (func == "MAX") return AggregationType::MAX;
+        return AggregationType::NONE;
+    }
+
+    Column parseSelectItem() {
+        const Token& start = peek();
+        size_t position = start.position;
+
+        if (matchSymbol("*")) {
+            Column col("*");
+            col.position = position;
+            return col;
+        }
+
+        const Token& name = expectIdentifier("column or aggregate");
+        std::string name_text = name.text;
 
-                size_t table_end = std::min(group_by_pos, sample_pos);
-                query->table_name = aqe::utils::trim(rest_str.substr(0, table_end));
+        if (aqe::utils::toUpper(name_text) == "ROW_NUMBER" && peek().isSymbol("(")) {
+            advance();
+            expectSymbol(")");
+            return parseWindowItem(WindowFunction::ROW_NUMBER, "*", "ROW_NUMBER()", position);
+        }
 
-                if (group_by_pos != std::string::npos) {
-                    size_t clause_end = (sample_pos > group_by_pos) ? sample_pos : std::string::npos;
-                    parseGroupBy(query, rest_str.substr(group_by_pos + 8, clause_end - (group_by_pos + 8)));
+        if (peek().isSymbol("(")) {
+            AggregationType agg = aggregationFromName(name_text);
+            if (agg == AggregationType::NONE) {
+                throw ParseError("Unknown aggregate function '" + name_text + "' at position " +
+                                 std::to_string(position), position);
+            }
+            advance();
+            std::string inner;
+            std::shared_ptr<const Expression> expression;
+            if (matchSymbol("*")) {
+                inner = "*";
+            } else {
+                Expression argument = parseExpression();
+                inner = argument.toString();
+                if (!argument.isColumn()) {
+                    expression = std::make_shared<const Expression>(std::move(argument));
                 }
-                
-                if (sample_pos != std::string::npos) {
-                    parseSampling(query, rest_str.substr(sample_pos + 6));
+            }
+            expectSymbol(")");
+
+            std::string default_alias = aqe::utils::toUpper(name_text) + "(" + aqe::utils::toUpper(inner) + ")";
+            if (peek().isKeyword("OVER")) {
+                if (expression) {
+                    throw ParseError("Window function argument must be a column", position);
                 }
+                return parseWindowItem(windowFunctionFor(agg), inner, default_alias, position);
+            }
+
+            std::string alias;
+            if (matchKeyword("AS")) {
+                alias = expectIdentifier("alias").text;
+            } else {
+                alias = default_alias;
             }
+            Column col(inner, alias, agg);
+            col.position = position;
+            col.expression = std::move(expression);
+            return col;
+        }
+
+        std::string alias;
+        if (matchKeyword("AS")) {
+            alias = expectIdentifier("alias").text;
+        }
+        Column col(name_text, alias);
+        col.position = position;
+        return col;
+    }
 
-            void parseGroupBy(Query* query, const std::string& group_by_str) {
-                std::stringstream ss(group_by_str);
-                std::string column;
-                while (std::getline(ss, column, ',')) {
-                    std::string trimmed_column = aqe::utils::trim(column);
-                    if (!trimmed_column.empty()) {
-                        query->group_by_columns.push_back(trimmed_column);
-                    }
+    static WindowFunction windowFunctionFor(AggregationType agg) {
+        switch (agg) {
+            case AggregationType::COUNT: return WindowFunction::COUNT;
+            case AggregationType::SUM: return WindowFunction::SUM;
+            case AggregationType::AVG: return WindowFunction::AVG;
+            case AggregationType::MIN: return WindowFunction::MIN;
+            default: return WindowFunction::MAX;
+        }
+    }
+
+    Column parseWindowItem(WindowFunction function, const std::string& argument,
+                           const std::string& default_alias, size_t position) {
+        expectKeyword("OVER");
+        expectSymbol("(");
+        auto window = std::make_shared<WindowSpec>();
+        window->function = function;
+        if (matchKeyword("PARTITION")) {
+            expectKeyword("BY");
+            do {
+                window->partition_by.push_back(expectIdentifier("PARTITION BY column").text);
+            } while (matchSymbol(","));
+        }
+        if (matchKeyword("ORDER")) {
+            expectKeyword("BY");
+            do {
+                WindowOrder order{expectIdentifier("window ORDER BY column").text};
+                if (matchKeyword("DESC")) {
+                    order.descending = true;
+                } else {
+                    matchKeyword("ASC");
                 }
+                window->order_by.push_back(std::move(order));
+            } while (matchSymbol(","));
+        }
+        if (matchKeyword("ROWS")) {
+            const Token& count = expectNumber("frame row count");
+            size_t rows = countFromLiteral(numberLiteral(count.text), "Frame row count", count.position);
+            if (function == WindowFunction::MIN || function == WindowFunction::MAX ||
+                function == WindowFunction::ROW_NUMBER) {
+                throw ParseError("ROWS frames are only supported for COUNT, SUM and AVG", count.position);
             }
-            size_t findKeyword(const std::string& query, const std::string& keyword) {
-                size_t pos = query.find(keyword);
-                if (pos == std::string::npos) {
-                    throw ParseError("Missing " + keyword + " clause");
+            window->preceding = rows;
+            expectKeyword("PRECEDING");
+        }
+        expectSymbol(")");
+
+        std::string alias = matchKeyword("AS") ? expectIdentifier("alias").text : default_alias;
+        Column col(argument, alias);
+        col.position = position;
+        col.window = std::move(window);
+        return col;
+    }
+
+    Predicate parseOrCondition(bool having) {
+        Predicate left = parseAndCondition(having);
+        if (!peek().isKeyword("OR")) return left;
+        Predicate node;
+        node.kind = Predicate::Kind::OR;
+        node.position = left.position;
+        node.children.push_back(std::move(left));
+        while (matchKeyword("OR")) {
+            node.children.push_back(parseAndCondition(having));
+        }
+        return node;
+    }
+
+    Predicate parseAndCondition(bool having) {
+        Predicate left = parseConditionTerm(having);
+        if (!peek().isKeyword("AND")) return left;
+        Predicate node;
+        node.kind = Predicate::Kind::AND;
+        node.position = left.position;
+        node.children.push_back(std::move(left));
+        while (matchKeyword("AND")) {
+            node.children.push_back(parseConditionTerm(having));
+        }
+        return node;
+    }
+
+    static bool compareOpFromSymbol(const Token& tok, CompareOp& op) {
+        if (tok.type != TokenType::SYMBOL) return false;
+        if (tok.text == "=") op = CompareOp::EQ;
+        else if (tok.text == "!=" || tok.text == "<>") op = CompareOp::NE;
+        else if (tok.text == "<") op = CompareOp::LT;
+        else if (tok.text == "<=") op = CompareOp::LE;
+        else if (tok.text == ">") op = CompareOp::GT;
+        else if (tok.text == ">=") op = CompareOp::GE;
+        else return false;
+        return true;
+    }
+
+    Predicate parseConditionTerm(bool having) {
+        if (matchSymbol("(")) {
+            Predicate inner = parseOrCondition(having);
+            expectSymbol(")");
+            return inner;
+        }
+
+        Predicate comparison;
+        const Token& column = peek();
+        comparison.position = column.position;
+        if (having) {
+            comparison.output_index = parseOutputReference(*target);
+            if (comparison.output_index < 0) {
+                throw ParseError("HAVING operand at position " + std::to_string(column.position) +
+                                 " does not match a selected column", column.position);
+            }
+            comparison.column = target->columns[comparison.output_index].alias.empty()
+                ? target->columns[comparison.output_index].name
+                : target->columns[comparison.output_index].alias;
+        } else {
+            comparison.column = expectIdentifier("column in WHERE clause").text;
+        }
+        if (!compareOpFromSymbol(peek(), comparison.op)) fail("comparison operator");
+        advance();
+
+        const Token& literal = peek();
+        if (literal.type == TokenType::NUMBER) {
+            comparison.value = numberLiteral(literal.text);
+        } else if (literal.type == TokenType::STRING) {
+            comparison.value = literal.text;
+        } else if (literal.isSymbol("?")) {
+            comparison.parameter_index = static_cast<long>(target->parameters.size());
+            target->parameters.push_back({having ? ParameterTarget::HAVING_VALUE : ParameterTarget::WHERE_VALUE,
+                                          literal.position});
+        } else {
+            fail("literal value");
+        }
+        advance();
+        return comparison;
+    }
+
+    // Parses an output_ref and resolves it against the select list: by output
+    // name (alias, or column name for plain columns) or by aggregate call.
+    // Returns the column index, or -1 if nothing matches.
+    long parseOutputReference(const Query& query) {
+        std::string name = expectIdentifier("column or aggregate").text;
+        std::string aggregate_name;
+        if (matchSymbol("(")) {
+            std::string inner = matchSymbol("*") ? "*" : parseExpression().toString();
+            expectSymbol(")");
+            aggregate_name = aqe::utils::toUpper(name) + "(" + aqe::utils::toUpper(inner) + ")";
+        }
+        for (size_t i = 0; i < query.columns.size(); ++i) {
+            const Column& col = query.columns[i];
+            if (!aggregate_name.empty()) {
+                if (col.aggregation != AggregationType::NONE &&
+                    std::string(nameOf(col.aggregation)) + "(" + aqe::utils::toUpper(col.name) + ")" == aggregate_name) {
+                    return static_cast<long>(i);
                 }
-                return pos;
-            }
-
-            // UPDATED: This function is now feature-complete
-            void parseSampling(Query* query, const std::string& sample_str) {
-                static const std::regex sample_regex(
-                    R"(\s*(?:(RESERVOIR)\s+(\d+)|(SYSTEMATIC)\s+(\d+)|(STRATIFIED)\s+BY\s+([\w]+)\s+(\d+(?:\.\d+)?)%|(\d+(?:\.\d+)?)%))", 
-                    std::regex::icase
-                );
-                
-                std::smatch matches;
-                if (std::regex_search(sample_str, matches, sample_regex)) {
-                    if (matches[1].matched) { // RESERVOIR
-                        query->sampling.method = SamplingMethod::RESERVOIR;
-                        query->sampling.size = std::stoull(matches[2].str());
-                    } else if (matches[3].matched) { // SYSTEMATIC
-                        query->sampling.method = SamplingMethod::SYSTEMATIC;
-                        query->sampling.size = std::stoull(matches[4].str());
-                    } else if (matches[5].matched) { // STRATIFIED
-                        query->sampling.method = SamplingMethod::STRATIFIED;
-                        query->sampling.stratification_column = matches[6].str();
-                        query->sampling.rate = std::stod(matches[7].str()) / 100.0;
-                    } else if (matches[8].matched) { // RANDOM (percentage)
-                        query->sampling.method = SamplingMethod::RANDOM;
-                        query->sampling.rate = std::stod(matches[8].str()) / 100.0;
-                    }
-                } else {
-                    throw ParseError("Invalid SAMPLE clause format");
+            } else if (col.alias == name || (col.aggregation == AggregationType::NONE && col.name == name)) {
+                return static_cast<long>(i);
+            }
+        }
+        return -1;
+    }
+
+    Expression parseExpression() {
+        Expression left = parseTerm();
+        while (peek().isSymbol("+") || peek().isSymbol("-")) {
+            const Token& op = advance();
+            Expression::Kind kind = op.text == "+" ? Expression::Kind::ADD : Expression::Kind::SUBTRACT;
+            left = Expression::makeOperation(kind, {std::move(left), parseTerm()}, op.position);
+        }
+        return left;
+    }
+
+    Expression parseTerm() {
+        Expression left = parseFactor();
+        while (peek().isSymbol("*") || peek().isSymbol("/")) {
+            const Token& op = advance();
+            Expression::Kind kind = op.text == "*" ? Expression::Kind::MULTIPLY : Expression::Kind::DIVIDE;
+            left = Expression::makeOperation(kind, {std::move(left), parseFactor()}, op.position);
+        }
+        return left;
+    }
+
+    Expression parseFactor() {
+        const Token& tok = peek();
+        if (tok.type == TokenType::NUMBER) {
+            advance();
+            return Expression::makeNumber(numberLiteral(tok.text), tok.position);
+        }
+        if (tok.type == TokenType::IDENTIFIER) {
+            advance();
+            return Expression::makeColumn(tok.text, tok.position);
+        }
+        if (matchSymbol("(")) {
+            Expression inner = parseExpression();
+            expectSymbol(")");
+            return inner;
+        }
+        if (matchSymbol("-")) {
+            return Expression::makeOperation(Expression::Kind::NEGATE, {parseFactor()}, tok.position);
+        }
+        fail("column, number or '('");
+    }
+
+    // Resolves each ORDER BY item against the select list, as an output_ref
+    // or a 1-based ordinal.
+    void parseOrderBy(Query& query) {
+        do {
+            const Token& start = peek();
+            OrderItem item{0, false, start.position};
+            long resolved = -1;
+
+            if (start.type == TokenType::NUMBER) {
+                double ordinal = numberLiteral(advance().text);
+                if (ordinal >= 1 && ordinal <= query.columns.size() && std::floor(ordinal) == ordinal) {
+                    resolved = static_cast<long>(ordinal) - 1;
                 }
+            } else {
+                resolved = parseOutputReference(query);
             }
-        };
+            if (resolved < 0) {
+                throw ParseError("ORDER BY item at position " + std::to_string(start.position) +
+                                 " does not match a selected column", start.position);
+            }
+            item.column_index = static_cast<size_t>(resolved);
+            if (matchKeyword("DESC")) {
+                item.descending = true;
+            } else {
+                matchKeyword("ASC");
+            }
+            query.order_by.push_back(item);
+        } while (matchSymbol(","));
+    }
+
+    static const char* nameOf(AggregationType type) {
+        switch (type) {
+            case AggregationType::COUNT: return "COUNT";
+            case AggregationType::SUM: return "SUM";
+            case AggregationType::AVG: return "AVG";
+            case AggregationType::MIN: return "MIN";
+            case AggregationType::MAX: return "MAX";
+            default: return "";
+        }
+    }
+
+    void parseGroupBy(Query& query) {
+        do {
+            query.group_by_columns.push_back(expectIdentifier("GROUP BY column").text);
+        } while (matchSymbol(","));
+    }
+
+    double parsePercentage() {
+        double pct = parseNumberOrParameter("sampling percentage", ParameterTarget::SAMPLE_PERCENT);
+        expectSymbol("%");
+        return pct / 100.0;
+    }
+
+    // A universe sample of a join hashes the join key, so both sides keep the
+    // same keys; it is recorded as the probe-side column. Without a join the
+    // key must be named.
+    std::string parseUniverseColumn(const Query& query) {
+        size_t position = peek().position;
+        std::string column;
+        if (matchKeyword("BY")) {
+            column = expectIdentifier("universe sampling column").text;
+        }
+        if (!query.join) {
+            if (column.empty()) fail("BY column for UNIVERSE sampling");
+            return column;
+        }
+        if (!column.empty() && column != query.join->probe_column && column != query.join->build_column) {
+            throw ParseError("UNIVERSE sampling of a join must use the join key", position);
+        }
+        return query.join->probe_column;
+    }
+
+    void parseSampling(Query& query) {
+        query.sampling.position = advance().position; // SAMPLE
+        if (matchKeyword("RESERVOIR")) {
+            query.sampling.method = SamplingMethod::RESERVOIR;
+            query.sampling.size = parseCountOrParameter("reservoir size", ParameterTarget::SAMPLE_SIZE);
+        } else if (matchKeyword("SYSTEMATIC")) {
+            query.sampling.method = SamplingMethod::SYSTEMATIC;
+            query.sampling.size = parseCountOrParameter("systematic step", ParameterTarget::SAMPLE_SIZE);
+        } else if (matchKeyword("STRATIFIED")) {
+            expectKeyword("BY");
+            query.sampling.method = SamplingMethod::STRATIFIED;
+            query.sampling.stratification_column = expectIdentifier("stratification column").text;
+            query.sampling.rate = parsePercentage();
+        } else if (matchKeyword("UNIVERSE")) {
+            query.sampling.method = SamplingMethod::UNIVERSE;
+            query.sampling.universe_column = parseUniverseColumn(query);
+            query.sampling.rate = parsePercentage();
+        } else if (peek().type == TokenType::NUMBER || peek().isSymbol("?")) {
+            query.sampling.method = SamplingMethod::RANDOM;
+            query.sampling.rate = parsePercentage();
+        } else {
+            fail("SAMPLE clause (percentage, RESERVOIR, SYSTEMATIC, STRATIFIED or UNIVERSE)");
+        }
+    }
+};
 
-    } // namespace query
-} // namespace aqe
\ No newline at end of file
+} // namespace query
+} // namespace aqe
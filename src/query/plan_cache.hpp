@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include "lexer.hpp"
+#include "parser.hpp"
+
+namespace aqe {
+namespace query {
+
+// Query text reduced to its shape: keywords and function names upper-cased,
+// whitespace collapsed and every literal replaced by `?`. Queries that differ
+// only in those respects share a key. Literals inside an aggregate call or
+// window, as in `SUM(value * 2)` or `OVER (ROWS 3 PRECEDING)`, are part of the
+// output column and stay in the key, as do ORDER BY ordinals.
+struct NormalizedQuery {
+    std::string key;
+    std::vector<Token> tokens;   // template tokens, literals replaced by '?'
+    std::vector<Value> literals; // extracted literals in source order
+};
+
+inline NormalizedQuery normalizeQuery(const std::string& query_str) {
+    NormalizedQuery normalized;
+    normalized.tokens = Lexer::tokenize(query_str);
+    normalized.key.reserve(query_str.size());
+
+    auto& tokens = normalized.tokens;
+    size_t call_depth = 0; // parentheses open inside an aggregate call
+    bool in_order_by = false;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        Token& tok = tokens[i];
+        if (tok.type == TokenType::END) break;
+
+        if (call_depth > 0) {
+            if (tok.isSymbol("(")) ++call_depth;
+            if (tok.isSymbol(")")) --call_depth;
+        } else if (tok.isKeyword("BY") && i > 0 && tokens[i - 1].isKeyword("ORDER")) {
+            in_order_by = true;
+        } else if (tok.isKeyword("LIMIT") || tok.isKeyword("SAMPLE")) {
+            in_order_by = false;
+        } else if (tok.type == TokenType::NUMBER && in_order_by) {
+            // An ordinal names an output column
+        } else if (tok.type == TokenType::NUMBER) {
+            normalized.literals.emplace_back(numberLiteral(tok.text));
+            tok = {TokenType::SYMBOL, "?", tok.position};
+        } else if (tok.type == TokenType::STRING) {
+            normalized.literals.emplace_back(tok.text);
+            tok = {TokenType::SYMBOL, "?", tok.position};
+        } else if ((tok.type == TokenType::IDENTIFIER || tok.isKeyword("OVER")) && tokens[i + 1].isSymbol("(")) {
+            tok.text = aqe::utils::toUpper(tok.text);
+            normalized.key += normalized.key.empty() ? "" : " ";
+            normalized.key += tok.text;
+            normalized.key += " (";
+            ++i;
+            call_depth = 1;
+            continue;
+        }
+
+        if (!normalized.key.empty()) normalized.key.push_back(' ');
+        normalized.key += tok.text;
+    }
+    return normalized;
+}
+
+// LRU cache of parsed query templates keyed by normalized query text. A hit
+// skips parsing and validation; the cached template is copied and the
+// literals of the incoming query are bound into it. Physical plans are not
+// cached: they point into the catalog version they were planned against,
+// which compaction replaces without changing the data version, and they
+// depend on the bound literals. Planning is a few lookups in the table's
+// statistics and cubes, so it is redone per query.
+class PlanCache {
+private:
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+
+    struct Entry {
+        std::string key;
+        std::shared_ptr<const Query> query;
+    };
+
+    std::list<Entry> lru; // most recently used at the front
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t capacity;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    QueryParser parser;
+
+public:
+    explicit PlanCache(size_t max_entries = DEFAULT_CAPACITY) : capacity(max_entries) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Plan cache capacity must be greater than 0");
+        }
+    }
+
+    // Returns a parsed, validated query for `query_str`, parsing it only if no
+    // query of the same shape is cached.
+    std::unique_ptr<Query> get(const std::string& query_str) {
+        NormalizedQuery normalized;
+        try {
+            normalized = normalizeQuery(query_str);
+        } catch (const LexError& e) {
+            throw ParseError(std::string("Failed to parse query: ") + e.what(), e.position());
+        }
+
+        auto query = std::make_unique<Query>(*lookup(normalized));
+        if (normalized.literals.size() != query->parameters.size()) {
+            throw ParseError("Query has " + std::to_string(query->parameters.size()) +
+                             " unbound parameter(s)");
+        }
+        for (size_t i = 0; i < normalized.literals.size(); ++i) {
+            query->bindParameter(i, normalized.literals[i]);
+        }
+        return query;
+    }
+
+    void clear() {
+        lru.clear();
+        index.clear();
+    }
+
+    size_t size() const { return lru.size(); }
+    size_t hits() const { return hit_count; }
+    size_t misses() const { return miss_count; }
+
+private:
+    std::shared_ptr<const Query> lookup(NormalizedQuery& normalized) {
+        if (auto it = index.find(normalized.key); it != index.end()) {
+            ++hit_count;
+            lru.splice(lru.begin(), lru, it->second);
+            return it->second->query;
+        }
+
+        ++miss_count;
+        std::shared_ptr<const Query> parsed = parser.parse(std::move(normalized.tokens));
+        lru.push_front({normalized.key, parsed});
+        index[normalized.key] = lru.begin();
+        if (lru.size() > capacity) {
+            index.erase(lru.back().key);
+            lru.pop_back();
+        }
+        return parsed;
+    }
+};
+
+} // namespace query
+} // namespace aqe
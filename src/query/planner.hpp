@@ -0,0 +1,268 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include "parser.hpp"
+#include "statistics.hpp"
+#include "cube.hpp"
+#include "cancellation.hpp"
+
+namespace aqe {
+namespace query {
+
+enum class LogicalOperator { SCAN, JOIN, FILTER, SAMPLE, AGGREGATE, PROJECT };
+
+// The query as a pipeline of relational operators, listed from the data
+// source upwards. Rewrite rules reorder this list; the physical planner then
+// picks an implementation for each step.
+struct LogicalPlan {
+    std::shared_ptr<const Query> query;
+    std::vector<LogicalOperator> operators;
+
+    bool has(LogicalOperator op) const {
+        for (auto o : operators) {
+            if (o == op) return true;
+        }
+        return false;
+    }
+
+    // True if SAMPLE runs before FILTER in the pipeline.
+    bool samplesBeforeFilter() const {
+        for (auto o : operators) {
+            if (o == LogicalOperator::SAMPLE) return has(LogicalOperator::FILTER);
+            if (o == LogicalOperator::FILTER) return false;
+        }
+        return false;
+    }
+};
+
+// How rows reach the aggregate: a full scan, a roll-up of a materialized
+// cube, or an answer read straight from table statistics (exact COUNT(*)) or
+// a frequency sketch (approximate COUNT(*) with a single equality filter).
+enum class AccessPath { TABLE_SCAN, CUBE_LOOKUP, STATISTICS_LOOKUP, SKETCH_LOOKUP };
+
+// How rows are mapped to groups: one implicit group, a short array searched
+// by value for low-cardinality keys, or a hash table.
+enum class GroupingStrategy { SINGLE, DIRECT_INDEXED, HASH };
+
+// One output aggregate reading from a fused input column. `input` indexes
+// PhysicalPlan::input_columns and is NO_INPUT for row counts.
+struct AggregateSpec {
+    static constexpr size_t NO_INPUT = static_cast<size_t>(-1);
+
+    AggregationType type;
+    size_t input;
+    size_t output_index;
+};
+
+struct PhysicalPlan {
+    std::shared_ptr<const Query> query;
+    const TableStatistics* statistics = nullptr;
+    const AggregateCube* cube = nullptr;
+    AccessPath access = AccessPath::TABLE_SCAN;
+    GroupingStrategy grouping = GroupingStrategy::SINGLE;
+    bool sample_before_filter = false;
+    // Fraction of the table's rows in the scanned input: below 1 when a
+    // random-sample query scans a stored sample of the table. The sample
+    // rate applied during the scan is divided by it.
+    double input_fraction = 1.0;
+
+    // Distinct inputs read by SUM/AVG/MIN/MAX, by column name or canonical
+    // expression text. Each is evaluated once per row and feeds every
+    // aggregate over it; `input_expressions` holds the tree for expression
+    // inputs and nullptr for plain columns.
+    std::vector<std::string> input_columns;
+    std::vector<std::shared_ptr<const Expression>> input_expressions;
+    std::vector<AggregateSpec> aggregates;
+
+    // Checked between row batches while the plan runs; null if the query
+    // cannot be cancelled.
+    std::shared_ptr<const CancellationToken> cancellation;
+
+    // Throws QueryCancelled if the plan's token was cancelled or expired.
+    void checkCancelled() const {
+        if (cancellation) cancellation->throwIfCancelled();
+    }
+
+    std::string explain() const {
+        std::ostringstream out;
+        const Query& q = *query;
+        out << "Project " << q.columns.size() << " column(s)\n";
+        if (access == AccessPath::STATISTICS_LOOKUP) {
+            out << "  StatisticsLookup row_count\n";
+            return out.str();
+        }
+        if (access == AccessPath::CUBE_LOOKUP) {
+            out << "  CubeRollUp " << cube->getDefinition().name << "\n";
+            return out.str();
+        }
+        if (access == AccessPath::SKETCH_LOOKUP) {
+            out << "  SketchLookup " << q.where->column << "\n";
+            return out.str();
+        }
+
+        if (q.hasWindowFunctions()) {
+            out << "  Window partition-sort\n";
+        } else {
+            out << "  Aggregate " << (grouping == GroupingStrategy::SINGLE ? "single-group"
+                                    : grouping == GroupingStrategy::DIRECT_INDEXED ? "direct-indexed" : "hash")
+                << " fused-inputs=" << input_columns.size() << "\n";
+        }
+        std::string filter = q.where ? "  Filter\n" : "";
+        std::string sample = q.sampling.method == SamplingMethod::UNIVERSE
+            ? "  UniverseSample " + q.sampling.universe_column + "\n"
+            : q.sampling.method != SamplingMethod::NONE ? "  Sample\n" : "";
+        out << (sample_before_filter ? filter + sample : sample + filter);
+        if (q.join) {
+            out << "  HashJoin " << (q.join->type == JoinType::SEMI ? "semi" : "inner")
+                << " build=" << q.join->table << " bloom-filter=" << q.join->probe_column << "\n";
+        }
+        out << "  Scan " << q.table_name;
+        if (input_fraction < 1.0) out << " stored-sample=" << input_fraction;
+        out << "\n";
+        return out.str();
+    }
+};
+
+// Builds the logical plan for a query, applies rewrite rules, and chooses
+// physical implementations using table statistics and declared cubes when
+// they are available. Every performance-relevant execution decision is made
+// here.
+class Planner {
+public:
+    // Single-column GROUP BYs with at most this many estimated distinct
+    // values use direct-indexed grouping.
+    static constexpr double DIRECT_GROUPING_MAX_DISTINCT = 64.0;
+
+    explicit Planner(const TableStatistics* stats = nullptr, const CubeRegistry* cube_registry = nullptr)
+        : statistics(stats), cubes(cube_registry) {}
+
+    LogicalPlan buildLogicalPlan(std::shared_ptr<const Query> query) const {
+        LogicalPlan plan;
+        plan.query = std::move(query);
+        plan.operators.push_back(LogicalOperator::SCAN);
+        if (plan.query->join) plan.operators.push_back(LogicalOperator::JOIN);
+        if (plan.query->where) plan.operators.push_back(LogicalOperator::FILTER);
+        if (plan.query->sampling.method != SamplingMethod::NONE) plan.operators.push_back(LogicalOperator::SAMPLE);
+        plan.operators.push_back(LogicalOperator::AGGREGATE);
+        plan.operators.push_back(LogicalOperator::PROJECT);
+        applyRewriteRules(plan);
+        return plan;
+    }
+
+    PhysicalPlan plan(std::shared_ptr<const Query> query) const {
+        return buildPhysicalPlan(buildLogicalPlan(std::move(query)));
+    }
+
+    // Plans a query the caller keeps alive for the lifetime of the plan.
+    PhysicalPlan plan(const Query& query) const {
+        return plan(std::shared_ptr<const Query>(std::shared_ptr<const Query>(), &query));
+    }
+
+    PhysicalPlan buildPhysicalPlan(const LogicalPlan& logical) const {
+        PhysicalPlan physical;
+        physical.query = logical.query;
+        physical.statistics = statistics;
+        physical.sample_before_filter = logical.samplesBeforeFilter();
+        const Query& query = *logical.query;
+
+        for (size_t i = 0; i < query.columns.size(); ++i) {
+            const Column& col = query.columns[i];
+            if (col.aggregation == AggregationType::NONE) continue;
+            size_t input = AggregateSpec::NO_INPUT;
+            if (col.aggregation != AggregationType::COUNT) {
+                input = inputIndex(physical, col);
+            }
+            physical.aggregates.push_back({col.aggregation, input, i});
+        }
+
+        physical.access = chooseAccessPath(query);
+        if (physical.access == AccessPath::TABLE_SCAN || physical.access == AccessPath::SKETCH_LOOKUP) {
+            // Rewrite: an exact roll-up of a small cube beats scanning rows,
+            // and beats a sketch estimate on accuracy
+            if (const AggregateCube* cube = cubes ? cubes->find(query) : nullptr) {
+                physical.access = AccessPath::CUBE_LOOKUP;
+                physical.cube = cube;
+            }
+        }
+        physical.grouping = chooseGrouping(query);
+        return physical;
+    }
+
+private:
+    const TableStatistics* statistics;
+    const CubeRegistry* cubes;
+
+    // Rule: random and universe sampling decide each row on its own (universe
+    // by its key alone), so sampling first and filtering the survivors is
+    // equivalent and evaluates the predicate on far fewer rows. Systematic
+    // sampling takes every k-th row that reaches it, which must be every k-th
+    // matching row; reservoir and stratified samples likewise depend on which
+    // rows reach them. All three must see filtered input.
+    static void applyRewriteRules(LogicalPlan& plan) {
+        SamplingMethod method = plan.query->sampling.method;
+        if (method != SamplingMethod::RANDOM && method != SamplingMethod::UNIVERSE) {
+            return;
+        }
+
+        auto& ops = plan.operators;
+        for (size_t i = 0; i + 1 < ops.size(); ++i) {
+            if (ops[i] == LogicalOperator::FILTER && ops[i + 1] == LogicalOperator::SAMPLE) {
+                std::swap(ops[i], ops[i + 1]);
+                break;
+            }
+        }
+    }
+
+    static size_t inputIndex(PhysicalPlan& physical, const Column& col) {
+        auto& inputs = physical.input_columns;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (inputs[i] == col.name) return i;
+        }
+        inputs.push_back(col.name);
+        physical.input_expressions.push_back(col.expression);
+        return inputs.size() - 1;
+    }
+
+    static bool onlyCountStar(const Query& query) {
+        for (const auto& col : query.columns) {
+            if (col.aggregation != AggregationType::COUNT || !col.is_star) return false;
+        }
+        return !query.columns.empty();
+    }
+
+    // Statistics, sketches and cubes describe a single table, so joins are
+    // always scanned.
+    AccessPath chooseAccessPath(const Query& query) const {
+        if (!statistics || query.join || !query.group_by_columns.empty() || !onlyCountStar(query)) {
+            return AccessPath::TABLE_SCAN;
+        }
+        if (!query.where && query.sampling.method == SamplingMethod::NONE) {
+            return AccessPath::STATISTICS_LOOKUP;
+        }
+        // Only approximate queries may be answered from a sketch.
+        if (query.where && query.sampling.method != SamplingMethod::NONE &&
+            query.where->kind == Predicate::Kind::COMPARISON && query.where->op == CompareOp::EQ &&
+            std::holds_alternative<std::string>(query.where->value)) {
+            const ColumnStatistics* col = statistics->column(query.where->column);
+            if (col && col->frequencies) return AccessPath::SKETCH_LOOKUP;
+        }
+        return AccessPath::TABLE_SCAN;
+    }
+
+    GroupingStrategy chooseGrouping(const Query& query) const {
+        if (query.group_by_columns.empty()) return GroupingStrategy::SINGLE;
+        if (statistics && !query.join && query.group_by_columns.size() == 1) {
+            const ColumnStatistics* col = statistics->column(query.group_by_columns[0]);
+            if (col && col->distinct_estimate <= DIRECT_GROUPING_MAX_DISTINCT) {
+                return GroupingStrategy::DIRECT_INDEXED;
+            }
+        }
+        return GroupingStrategy::HASH;
+    }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <variant>
+#include "data_row.hpp"
+#include "parser.hpp"
+#include "statistics.hpp"
+
+namespace aqe {
+namespace query {
+
+inline bool applyCompareOp(CompareOp op, int cmp) {
+    switch (op) {
+        case CompareOp::EQ: return cmp == 0;
+        case CompareOp::NE: return cmp != 0;
+        case CompareOp::LT: return cmp < 0;
+        case CompareOp::LE: return cmp <= 0;
+        case CompareOp::GT: return cmp > 0;
+        case CompareOp::GE: return cmp >= 0;
+    }
+    return false;
+}
+
+// Compares a number against a literal. String literals never match.
+inline bool compareNumber(double value, CompareOp op, const Value& literal) {
+    const double* number = std::get_if<double>(&literal);
+    if (!number) return false;
+    return applyCompareOp(op, value < *number ? -1 : (value > *number ? 1 : 0));
+}
+
+// Compares a cell against a literal. Numeric literals compare numerically
+// and reject text that does not parse as a number; string literals compare
+// lexicographically.
+inline bool compareText(const std::string& text, CompareOp op, const Value& literal) {
+    if (std::holds_alternative<double>(literal)) {
+        double value;
+        return parseNumber(text, value) && compareNumber(value, op, literal);
+    }
+    return applyCompareOp(op, text.compare(std::get<std::string>(literal)));
+}
+
+// Walks the AND/OR structure of a predicate, calling `leaf` for each
+// comparison that needs evaluating.
+template<typename LeafEvaluator>
+bool evaluatePredicate(const Predicate& predicate, const LeafEvaluator& leaf) {
+    switch (predicate.kind) {
+        case Predicate::Kind::AND:
+            for (const auto& child : predicate.children) {
+                if (!evaluatePredicate(child, leaf)) return false;
+            }
+            return true;
+        case Predicate::Kind::OR:
+            for (const auto& child : predicate.children) {
+                if (evaluatePredicate(child, leaf)) return true;
+            }
+            return false;
+        case Predicate::Kind::COMPARISON:
+            break;
+    }
+    return leaf(predicate);
+}
+
+// Evaluates a WHERE predicate against a row. Missing columns never match.
+inline bool matchesPredicate(const Predicate& predicate, const DataRow& row) {
+    return evaluatePredicate(predicate, [&row](const Predicate& comparison) {
+        auto it = row.values.find(comparison.column);
+        return it != row.values.end() && compareText(it->second, comparison.op, comparison.value);
+    });
+}
+
+} // namespace query
+} // namespace aqe
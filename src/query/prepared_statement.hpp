@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <optional>
+#include "parser.hpp"
+#include "executor.hpp"
+
+namespace aqe {
+namespace query {
+
+// A query parsed once with `?` placeholders and executed many times with
+// different bound values, e.g.
+//
+//   PreparedStatement stmt("SELECT COUNT(*) FROM data WHERE region = ? SAMPLE ?%");
+//   stmt.bind(0, "EU").bind(1, 10.0);
+//   auto result = stmt.execute(rows);
+//
+// Parameters are indexed from 0 in source order. Bindings persist across
+// executions until rebound or cleared.
+class PreparedStatement {
+private:
+    std::shared_ptr<const Query> query_template;
+    std::vector<std::optional<Value>> bindings;
+
+public:
+    explicit PreparedStatement(const std::string& query_str)
+        : PreparedStatement(std::shared_ptr<const Query>(QueryParser().parse(query_str))) {}
+
+    explicit PreparedStatement(std::shared_ptr<const Query> parsed)
+        : query_template(std::move(parsed)), bindings(query_template->parameters.size()) {}
+
+    size_t parameterCount() const { return bindings.size(); }
+
+    PreparedStatement& bind(size_t index, const Value& value) {
+        if (index >= bindings.size()) {
+            throw std::out_of_range("Parameter index " + std::to_string(index) +
+                                    " out of range for statement with " +
+                                    std::to_string(bindings.size()) + " parameter(s)");
+        }
+        bindings[index] = value;
+        return *this;
+    }
+
+    PreparedStatement& bind(size_t index, double value) { return bind(index, Value(value)); }
+    PreparedStatement& bind(size_t index, const char* value) { return bind(index, Value(std::string(value))); }
+    PreparedStatement& bind(size_t index, const std::string& value) { return bind(index, Value(value)); }
+
+    void clearBindings() {
+        for (auto& binding : bindings) binding.reset();
+    }
+
+    // Produces the query with the current bindings applied. Throws if a
+    // parameter is unbound or a bound value is invalid for its position.
+    std::unique_ptr<Query> boundQuery() const {
+        auto query = std::make_unique<Query>(*query_template);
+        for (size_t i = 0; i < bindings.size(); ++i) {
+            if (!bindings[i]) {
+                throw std::invalid_argument("Parameter " + std::to_string(i) + " is not bound");
+            }
+            query->bindParameter(i, *bindings[i]);
+        }
+        return query;
+    }
+
+    std::unique_ptr<QueryResult> execute(const RowSet& data) const {
+        QueryExecutor executor;
+        return executor.execute(*boundQuery(), data);
+    }
+
+    const Query& getQuery() const { return *query_template; }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <cstdint>
+#include <charconv>
+#include <unordered_map>
+#include "parser.hpp"
+#include "executor.hpp"
+
+namespace aqe {
+namespace query {
+
+namespace detail {
+
+inline void appendPredicateKey(const Predicate& predicate, std::string& key) {
+    switch (predicate.kind) {
+        case Predicate::Kind::AND:
+        case Predicate::Kind::OR:
+            key += predicate.kind == Predicate::Kind::AND ? "AND(" : "OR(";
+            for (const auto& child : predicate.children) {
+                appendPredicateKey(child, key);
+                key.push_back(',');
+            }
+            key.push_back(')');
+            return;
+        case Predicate::Kind::COMPARISON:
+            break;
+    }
+    key += predicate.column;
+    if (predicate.output_index >= 0) key += "@" + std::to_string(predicate.output_index);
+    key += "#" + std::to_string(static_cast<int>(predicate.op)) + "#";
+    if (const double* number = std::get_if<double>(&predicate.value)) {
+        // Shortest text that parses back to the same double
+        char buffer[32];
+        key += "n";
+        key.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), *number).ptr);
+    } else {
+        const std::string& text = std::get<std::string>(predicate.value);
+        key += "s" + std::to_string(text.size()) + ":" + text;
+    }
+}
+
+inline void appendWindowKey(const WindowSpec& window, std::string& key) {
+    key += ":W" + std::to_string(static_cast<int>(window.function)) + "(";
+    for (const auto& col : window.partition_by) key += col + ",";
+    key += ";";
+    for (const auto& item : window.order_by) key += item.column + (item.descending ? "d," : "a,");
+    if (window.preceding) key += ";" + std::to_string(*window.preceding);
+    key += ")";
+}
+
+} // namespace detail
+
+// Identifies what a query computes, ignoring how it is sampled: table,
+// output columns, filters, grouping, ordering and limit. Results of queries
+// with equal keys differ only in accuracy.
+inline std::string resultCacheKey(const Query& query) {
+    std::string key = query.table_name;
+    if (query.join) {
+        key += (query.join->type == JoinType::SEMI ? "~" : "*") + query.join->table + "(" +
+               query.join->probe_column + "=" + query.join->build_column + ")";
+    }
+    key += "|";
+    for (const auto& col : query.columns) {
+        key += std::to_string(static_cast<int>(col.aggregation)) + ":" + col.name + ":" + col.alias;
+        if (col.window) detail::appendWindowKey(*col.window, key);
+        key += ",";
+    }
+    key += "|";
+    if (query.where) detail::appendPredicateKey(*query.where, key);
+    key += "|";
+    for (const auto& col : query.group_by_columns) {
+        key += col + ",";
+    }
+    key += "|";
+    if (query.having) detail::appendPredicateKey(*query.having, key);
+    key += "|";
+    for (const auto& item : query.order_by) {
+        key += std::to_string(item.column_index) + (item.descending ? "d," : "a,");
+    }
+    if (query.limit) key += "|" + std::to_string(*query.limit);
+    return key;
+}
+
+// True if a result computed with `cached` sampling is at least as accurate as
+// one computed with `requested` sampling. An exact result satisfies any
+// request; a sample satisfies requests for the same kind of sample that is no
+// larger. Exact requests are only satisfied by exact results.
+inline bool samplingCovers(const Sampling& cached, const Sampling& requested) {
+    if (cached.method == SamplingMethod::NONE) return true;
+    if (requested.method == SamplingMethod::NONE) return false;
+
+    auto row_independent = [](SamplingMethod m) {
+        return m == SamplingMethod::RANDOM || m == SamplingMethod::SYSTEMATIC;
+    };
+    auto effective_rate = [](const Sampling& s) {
+        return s.method == SamplingMethod::SYSTEMATIC ? 1.0 / static_cast<double>(s.size) : s.rate;
+    };
+
+    if (row_independent(cached.method) && row_independent(requested.method)) {
+        return effective_rate(cached) >= effective_rate(requested);
+    }
+    if (cached.method != requested.method) return false;
+    if (cached.method == SamplingMethod::RESERVOIR) {
+        return cached.size >= requested.size;
+    }
+    return cached.stratification_column == requested.stratification_column &&
+           cached.universe_column == requested.universe_column && cached.rate >= requested.rate;
+}
+
+// LRU cache of query results keyed by what the query computes and the version
+// of the data it ran over. A sampled query is answered from any cached result
+// for the same key that is exact or drawn from a larger sample; bumping the
+// data version makes every older entry a miss.
+class ResultCache {
+private:
+    static constexpr size_t DEFAULT_CAPACITY = 256;
+
+    struct Entry {
+        std::string key;
+        Sampling sampling;
+        uint64_t data_version;
+        std::shared_ptr<const QueryResult> result;
+    };
+
+    std::list<Entry> lru; // most recently used at the front
+    std::unordered_map<std::string, std::vector<std::list<Entry>::iterator>> index;
+    size_t capacity;
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+
+public:
+    explicit ResultCache(size_t max_entries = DEFAULT_CAPACITY) : capacity(max_entries) {
+        if (capacity == 0) {
+            throw std::invalid_argument("Result cache capacity must be greater than 0");
+        }
+    }
+
+    std::shared_ptr<const QueryResult> lookup(const Query& query, uint64_t data_version) {
+        auto it = index.find(resultCacheKey(query));
+        if (it != index.end()) {
+            auto& entries = it->second;
+            for (size_t i = 0; i < entries.size();) {
+                auto entry = entries[i];
+                if (entry->data_version != data_version) {
+                    // Stale: the data changed since this result was computed
+                    lru.erase(entry);
+                    entries.erase(entries.begin() + i);
+                    continue;
+                }
+                if (samplingCovers(entry->sampling, query.sampling)) {
+                    ++hit_count;
+                    lru.splice(lru.begin(), lru, entry);
+                    return entry->result;
+                }
+                ++i;
+            }
+            if (entries.empty()) index.erase(it);
+        }
+        ++miss_count;
+        return nullptr;
+    }
+
+    void store(const Query& query, uint64_t data_version, std::shared_ptr<const QueryResult> result) {
+        std::string key = resultCacheKey(query);
+        auto& entries = index[key];
+
+        // Drop entries the new result makes redundant
+        for (size_t i = 0; i < entries.size();) {
+            auto entry = entries[i];
+            if (entry->data_version != data_version || samplingCovers(query.sampling, entry->sampling)) {
+                lru.erase(entry);
+                entries.erase(entries.begin() + i);
+            } else {
+                ++i;
+            }
+        }
+
+        lru.push_front({key, query.sampling, data_version, std::move(result)});
+        entries.push_back(lru.begin());
+        if (lru.size() > capacity) {
+            evictLeastRecentlyUsed();
+        }
+    }
+
+    void clear() {
+        lru.clear();
+        index.clear();
+    }
+
+    size_t size() const { return lru.size(); }
+    size_t hits() const { return hit_count; }
+    size_t misses() const { return miss_count; }
+
+private:
+    void evictLeastRecentlyUsed() {
+        auto victim = std::prev(lru.end());
+        auto it = index.find(victim->key);
+        auto& entries = it->second;
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (entries[i] == victim) {
+                entries.erase(entries.begin() + i);
+                break;
+            }
+        }
+        if (entries.empty()) index.erase(it);
+        lru.erase(victim);
+    }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,495 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <algorithm>
+#include "executor.hpp"
+
+namespace aqe {
+namespace query {
+
+enum class ColumnType : uint8_t { FLOAT64 = 0, UTF8 = 1 };
+
+// One typed result column. FLOAT64 columns hold `numbers`, with `nulls` set
+// for rows that had no value (empty when there are none); UTF8 columns hold
+// all values back to back in `text` with `offsets[i]..offsets[i + 1]`
+// delimiting row i.
+struct ResultColumn {
+    std::string name;
+    ColumnType type = ColumnType::UTF8;
+    std::vector<double> numbers;
+    std::vector<bool> nulls;
+    std::vector<uint32_t> offsets;
+    std::string text;
+
+    bool isNull(size_t row) const { return !nulls.empty() && nulls[row]; }
+    size_t nullCount() const { return static_cast<size_t>(std::count(nulls.begin(), nulls.end(), true)); }
+
+    std::string_view textAt(size_t row) const {
+        return std::string_view(text).substr(offsets[row], offsets[row + 1] - offsets[row]);
+    }
+};
+
+// A query result laid out by column with a type per column. Given the query,
+// aggregate and window columns are FLOAT64 whatever the rows hold, so the
+// schema does not depend on the data (text other than numbers becomes a null).
+// Other columns, and every column without the query, are FLOAT64 if every
+// value in them is a number or "NULL" (which becomes a null) and UTF8
+// otherwise (numbers formatted as in QueryResult::getRows()). This is the form
+// the binary and Arrow exporters write, so downstream tools read values
+// without re-parsing text.
+class ColumnarResult {
+public:
+    size_t row_count = 0;
+    bool approximate = false;
+    std::vector<ResultColumn> columns;
+
+    static ColumnarResult fromResult(const QueryResult& result) {
+        return build(result, std::vector<bool>(result.getColumnNames().size(), false));
+    }
+
+    static ColumnarResult fromResult(const QueryResult& result, const Query& query) {
+        std::vector<bool> numeric(result.getColumnNames().size(), false);
+        if (query.columns.size() == numeric.size()) {
+            for (size_t c = 0; c < numeric.size(); ++c) {
+                numeric[c] = query.columns[c].aggregation != AggregationType::NONE || query.columns[c].window;
+            }
+        }
+        return build(result, numeric);
+    }
+
+private:
+    static ColumnarResult build(const QueryResult& result, const std::vector<bool>& declared_numeric) {
+        ColumnarResult columnar;
+        const auto& rows = result.getValues();
+        columnar.row_count = rows.size();
+        columnar.approximate = result.isApproximate();
+
+        const auto& names = result.getColumnNames();
+        for (size_t c = 0; c < names.size(); ++c) {
+            ResultColumn column;
+            column.name = names[c];
+            bool numeric = false, has_null = false, has_text = false;
+            for (const auto& row : rows) {
+                if (std::holds_alternative<double>(row[c])) {
+                    numeric = true;
+                } else if (std::get<std::string>(row[c]) == "NULL") {
+                    has_null = true;
+                } else {
+                    has_text = true;
+                }
+            }
+            if (declared_numeric[c]) {
+                has_null = has_null || has_text;
+                numeric = true;
+            } else {
+                numeric = numeric && !has_text;
+            }
+            column.type = numeric ? ColumnType::FLOAT64 : ColumnType::UTF8;
+            if (numeric) {
+                column.numbers.reserve(rows.size());
+                if (has_null) column.nulls.reserve(rows.size());
+                for (const auto& row : rows) {
+                    const double* number = std::get_if<double>(&row[c]);
+                    column.numbers.push_back(number ? *number : 0.0);
+                    if (has_null) column.nulls.push_back(number == nullptr);
+                }
+            } else {
+                column.offsets.reserve(rows.size() + 1);
+                column.offsets.push_back(0);
+                for (const auto& row : rows) {
+                    if (const double* number = std::get_if<double>(&row[c])) {
+                        utils::appendFixed(column.text, *number);
+                    } else {
+                        column.text += std::get<std::string>(row[c]);
+                    }
+                    if (column.text.size() > UINT32_MAX) {
+                        throw std::length_error("Column '" + column.name + "' holds more text than 32-bit offsets can address");
+                    }
+                    column.offsets.push_back(static_cast<uint32_t>(column.text.size()));
+                }
+            }
+            columnar.columns.push_back(std::move(column));
+        }
+        return columnar;
+    }
+};
+
+namespace detail {
+
+// Little-endian encoding independent of the host byte order.
+template <typename T>
+void putLE(std::string& out, T value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+template <typename T>
+void patchLE(std::string& out, size_t pos, T value) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[pos + i] = static_cast<char>((bits >> (8 * i)) & 0xFF);
+    }
+}
+
+// Throws unless `count` items of `size` bytes follow `pos`.
+inline void need(std::string_view in, size_t pos, uint64_t count, size_t size = 1) {
+    if (pos > in.size() || count > (in.size() - pos) / size) {
+        throw std::runtime_error("Truncated result data");
+    }
+}
+
+template <typename T>
+T getLE(std::string_view in, size_t& pos) {
+    need(in, pos, sizeof(T));
+    uint64_t bits = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(in[pos + i])) << (8 * i);
+    }
+    pos += sizeof(T);
+    T value;
+    std::memcpy(&value, &bits, sizeof(T));
+    return value;
+}
+
+inline void padTo(std::string& out, size_t alignment, size_t remainder = 0) {
+    while (out.size() % alignment != remainder) out.push_back('\0');
+}
+
+// Packs flags LSB first; each bit is set where flags[i] == `set_when`.
+inline void appendBitmap(std::string& out, const std::vector<bool>& flags, bool set_when) {
+    for (size_t i = 0; i < flags.size(); i += 8) {
+        uint8_t bits = 0;
+        for (size_t b = 0; b < 8 && i + b < flags.size(); ++b) {
+            if (flags[i + b] == set_when) bits |= static_cast<uint8_t>(1u << b);
+        }
+        out.push_back(static_cast<char>(bits));
+    }
+}
+
+// Minimal front-to-back FlatBuffers writer, enough for Arrow's Message,
+// Schema, Field and RecordBatch tables. Each table is written after its
+// vtable, and objects a table refers to are written after it, so every
+// uoffset points forward as the format requires.
+class FlatBufferWriter {
+public:
+    struct Field {
+        uint16_t id;
+        uint8_t size;       // 1, 2, 4 or 8 bytes
+        uint64_t bits = 0;  // scalar value
+        bool is_offset = false;
+    };
+
+    std::string buf;
+
+    FlatBufferWriter() { putLE<uint32_t>(buf, 0); } // root offset, patched by finish()
+
+    // Writes a table and returns its position; `slots[i]` receives the
+    // position of fields[i] so offset fields can be patched later.
+    size_t table(std::vector<Field> fields, std::vector<size_t>* slots = nullptr) {
+        uint16_t num_ids = 0;
+        bool has_wide = false;
+        for (const auto& f : fields) {
+            num_ids = std::max<uint16_t>(num_ids, f.id + 1);
+            has_wide = has_wide || f.size == 8;
+        }
+
+        padTo(buf, 2);
+        size_t vtable = buf.size();
+        putLE<uint16_t>(buf, static_cast<uint16_t>(4 + 2 * num_ids));
+        putLE<uint16_t>(buf, 0);
+        for (uint16_t i = 0; i < num_ids; ++i) putLE<uint16_t>(buf, 0);
+
+        // With the table start at 4 mod 8, fields laid out widest first
+        // after the 4-byte vtable offset are naturally aligned.
+        has_wide ? padTo(buf, 8, 4) : padTo(buf, 4);
+        size_t table_pos = buf.size();
+        putLE<int32_t>(buf, static_cast<int32_t>(table_pos - vtable));
+
+        std::vector<size_t> order(fields.size());
+        for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+        std::stable_sort(order.begin(), order.end(),
+                         [&](size_t a, size_t b) { return fields[a].size > fields[b].size; });
+        if (slots) slots->assign(fields.size(), 0);
+        for (size_t i : order) {
+            const Field& f = fields[i];
+            padTo(buf, f.size);
+            size_t pos = buf.size();
+            for (uint8_t b = 0; b < f.size; ++b) buf.push_back(static_cast<char>((f.bits >> (8 * b)) & 0xFF));
+            patchLE<uint16_t>(buf, vtable + 4 + 2 * f.id, static_cast<uint16_t>(pos - table_pos));
+            if (slots) (*slots)[i] = pos;
+        }
+        patchLE<uint16_t>(buf, vtable + 2, static_cast<uint16_t>(buf.size() - table_pos));
+        return table_pos;
+    }
+
+    size_t string(std::string_view text) {
+        padTo(buf, 4);
+        size_t pos = buf.size();
+        putLE<uint32_t>(buf, static_cast<uint32_t>(text.size()));
+        buf.append(text.data(), text.size());
+        buf.push_back('\0');
+        return pos;
+    }
+
+    // Vector of offsets to objects written later; returns the element slots.
+    size_t offsetVector(size_t count, std::vector<size_t>& slots) {
+        padTo(buf, 4);
+        size_t pos = buf.size();
+        putLE<uint32_t>(buf, static_cast<uint32_t>(count));
+        slots.clear();
+        for (size_t i = 0; i < count; ++i) {
+            slots.push_back(buf.size());
+            putLE<uint32_t>(buf, 0);
+        }
+        return pos;
+    }
+
+    // Vector of structs made of two int64s (Arrow's FieldNode and Buffer).
+    size_t pairVector(const std::vector<std::pair<int64_t, int64_t>>& items) {
+        padTo(buf, 8, 4);
+        size_t pos = buf.size();
+        putLE<uint32_t>(buf, static_cast<uint32_t>(items.size()));
+        for (const auto& [a, b] : items) {
+            putLE<int64_t>(buf, a);
+            putLE<int64_t>(buf, b);
+        }
+        return pos;
+    }
+
+    void link(size_t slot, size_t target) {
+        patchLE<uint32_t>(buf, slot, static_cast<uint32_t>(target - slot));
+    }
+
+    std::string finish(size_t root) {
+        link(0, root);
+        padTo(buf, 8);
+        return std::move(buf);
+    }
+};
+
+// Arrow flatbuffer constants (Schema.fbs / Message.fbs)
+constexpr uint64_t ARROW_METADATA_V5 = 4;
+constexpr uint64_t ARROW_HEADER_SCHEMA = 1;
+constexpr uint64_t ARROW_HEADER_RECORD_BATCH = 3;
+constexpr uint64_t ARROW_TYPE_FLOATING_POINT = 3;
+constexpr uint64_t ARROW_TYPE_UTF8 = 5;
+constexpr uint64_t ARROW_PRECISION_DOUBLE = 2;
+
+inline std::string arrowSchemaMessage(const ColumnarResult& result) {
+    FlatBufferWriter fb;
+    std::vector<size_t> message_slots;
+    size_t message = fb.table({{0, 2, ARROW_METADATA_V5}, {1, 1, ARROW_HEADER_SCHEMA},
+                               {2, 4, 0, true}, {3, 8, 0}}, &message_slots);
+    std::vector<size_t> schema_slots;
+    size_t schema = fb.table({{0, 2, 0}, {1, 4, 0, true}}, &schema_slots);
+    fb.link(message_slots[2], schema);
+
+    std::vector<size_t> field_slots;
+    fb.link(schema_slots[1], fb.offsetVector(result.columns.size(), field_slots));
+    for (size_t c = 0; c < result.columns.size(); ++c) {
+        bool numeric = result.columns[c].type == ColumnType::FLOAT64;
+        std::vector<size_t> slots;
+        size_t field = fb.table({{0, 4, 0, true}, {1, 1, 1},
+                                 {2, 1, numeric ? ARROW_TYPE_FLOATING_POINT : ARROW_TYPE_UTF8},
+                                 {3, 4, 0, true}, {5, 4, 0, true}}, &slots);
+        fb.link(field_slots[c], field);
+        fb.link(slots[0], fb.string(result.columns[c].name));
+        fb.link(slots[3], numeric ? fb.table({{0, 2, ARROW_PRECISION_DOUBLE}}) : fb.table({}));
+        std::vector<size_t> no_children;
+        fb.link(slots[4], fb.offsetVector(0, no_children));
+    }
+    return fb.finish(message);
+}
+
+inline std::string arrowRecordBatchMessage(const ColumnarResult& result, size_t body_length,
+                                           const std::vector<std::pair<int64_t, int64_t>>& buffers) {
+    FlatBufferWriter fb;
+    std::vector<size_t> message_slots;
+    size_t message = fb.table({{0, 2, ARROW_METADATA_V5}, {1, 1, ARROW_HEADER_RECORD_BATCH},
+                               {2, 4, 0, true}, {3, 8, body_length}}, &message_slots);
+    std::vector<size_t> batch_slots;
+    size_t batch = fb.table({{0, 8, result.row_count}, {1, 4, 0, true}, {2, 4, 0, true}}, &batch_slots);
+    fb.link(message_slots[2], batch);
+
+    std::vector<std::pair<int64_t, int64_t>> nodes;
+    for (const auto& column : result.columns) {
+        nodes.push_back({static_cast<int64_t>(result.row_count), static_cast<int64_t>(column.nullCount())});
+    }
+    fb.link(batch_slots[1], fb.pairVector(nodes));
+    fb.link(batch_slots[2], fb.pairVector(buffers));
+    return fb.finish(message);
+}
+
+// Encapsulated IPC message: continuation marker, metadata length, metadata
+// (padded to 8 bytes), body.
+inline void appendArrowMessage(std::string& out, const std::string& metadata, const std::string& body) {
+    putLE<uint32_t>(out, 0xFFFFFFFFu);
+    putLE<int32_t>(out, static_cast<int32_t>(metadata.size()));
+    out += metadata;
+    out += body;
+}
+
+// Throws unless a UTF8 column's offsets delimit `rows` values in its text and
+// every offset fits in `limit`.
+inline void checkTextColumn(const ResultColumn& column, size_t rows, uint64_t limit) {
+    if (column.text.size() > limit) {
+        throw std::length_error("Column '" + column.name + "' holds more text than its offsets can address");
+    }
+    if (column.offsets.size() != rows + 1 || column.offsets.front() != 0 ||
+        column.offsets.back() != column.text.size() ||
+        !std::is_sorted(column.offsets.begin(), column.offsets.end())) {
+        throw std::invalid_argument("Column '" + column.name + "' has offsets that do not match its text");
+    }
+}
+
+} // namespace detail
+
+// Compact binary encoding of a columnar result:
+//
+//   "AQER" u32 version=1 u64 rows u32 columns u8 approximate
+//   per column: u8 type, u32 name length, name bytes
+//   per column: FLOAT64 -> u8 has_nulls, [null bitmap, 1 = null], rows f64
+//               UTF8    -> (rows + 1) u32 offsets, u32 text length, text
+//
+// Null bitmaps hold (rows + 7) / 8 bytes, row i at bit i % 8 of byte i / 8.
+// Offsets start at 0, never decrease and end at the text length.
+//
+// All integers and doubles are little-endian. Throws std::length_error for a
+// column whose text does not fit 32-bit offsets, before writing anything.
+inline void writeBinary(const ColumnarResult& result, std::string& out) {
+    using detail::putLE;
+    for (const auto& column : result.columns) {
+        if (column.type == ColumnType::UTF8) detail::checkTextColumn(column, result.row_count, UINT32_MAX);
+    }
+    out += "AQER";
+    putLE<uint32_t>(out, 1);
+    putLE<uint64_t>(out, result.row_count);
+    putLE<uint32_t>(out, static_cast<uint32_t>(result.columns.size()));
+    out.push_back(result.approximate ? 1 : 0);
+    for (const auto& column : result.columns) {
+        out.push_back(static_cast<char>(column.type));
+        putLE<uint32_t>(out, static_cast<uint32_t>(column.name.size()));
+        out += column.name;
+    }
+    for (const auto& column : result.columns) {
+        if (column.type == ColumnType::FLOAT64) {
+            out.push_back(column.nulls.empty() ? 0 : 1);
+            if (!column.nulls.empty()) detail::appendBitmap(out, column.nulls, true);
+            for (double value : column.numbers) putLE<double>(out, value);
+        } else {
+            for (uint32_t offset : column.offsets) putLE<uint32_t>(out, offset);
+            putLE<uint32_t>(out, static_cast<uint32_t>(column.text.size()));
+            out += column.text;
+        }
+    }
+}
+
+// Decodes writeBinary() output. Throws std::runtime_error on malformed input.
+inline ColumnarResult readBinary(std::string_view in) {
+    using detail::getLE;
+    using detail::need;
+    if (in.substr(0, 4) != "AQER") {
+        throw std::runtime_error("Not an AQE binary result");
+    }
+    size_t pos = 4;
+    if (getLE<uint32_t>(in, pos) != 1) {
+        throw std::runtime_error("Unsupported AQE binary result version");
+    }
+    ColumnarResult result;
+    result.row_count = getLE<uint64_t>(in, pos);
+    uint32_t num_columns = getLE<uint32_t>(in, pos);
+    result.approximate = getLE<uint8_t>(in, pos) != 0;
+    // Check counts against the bytes left before allocating for them
+    need(in, pos, num_columns, 5); // type and name length
+    result.columns.resize(num_columns);
+    for (auto& column : result.columns) {
+        uint8_t type = getLE<uint8_t>(in, pos);
+        if (type > static_cast<uint8_t>(ColumnType::UTF8)) {
+            throw std::runtime_error("Unknown column type in result data");
+        }
+        column.type = static_cast<ColumnType>(type);
+        uint32_t length = getLE<uint32_t>(in, pos);
+        need(in, pos, length);
+        column.name = std::string(in.substr(pos, length));
+        pos += length;
+    }
+    for (auto& column : result.columns) {
+        if (column.type == ColumnType::FLOAT64) {
+            bool has_nulls = getLE<uint8_t>(in, pos) != 0;
+            if (has_nulls) {
+                need(in, pos, result.row_count / 8 + (result.row_count % 8 != 0));
+                column.nulls.resize(result.row_count);
+                for (size_t i = 0; i < result.row_count; i += 8) {
+                    uint8_t bits = getLE<uint8_t>(in, pos);
+                    for (size_t b = 0; b < 8 && i + b < result.row_count; ++b) column.nulls[i + b] = (bits >> b) & 1;
+                }
+            }
+            need(in, pos, result.row_count, sizeof(double));
+            column.numbers.resize(result.row_count);
+            for (auto& value : column.numbers) value = getLE<double>(in, pos);
+        } else {
+            need(in, pos, result.row_count, sizeof(uint32_t));
+            column.offsets.resize(result.row_count + 1);
+            for (auto& offset : column.offsets) offset = getLE<uint32_t>(in, pos);
+            uint32_t length = getLE<uint32_t>(in, pos);
+            need(in, pos, length);
+            if (column.offsets.front() != 0 || column.offsets.back() != length ||
+                !std::is_sorted(column.offsets.begin(), column.offsets.end())) {
+                throw std::runtime_error("Corrupt text offsets in result data");
+            }
+            column.text = std::string(in.substr(pos, length));
+            pos += length;
+        }
+    }
+    return result;
+}
+
+// Writes the result as an Arrow IPC stream: a Schema message, one
+// RecordBatch holding every row, and the end-of-stream marker. FLOAT64
+// columns become Arrow float64 and UTF8 columns Arrow utf8. Only columns with
+// nulls carry a validity bitmap. Throws std::length_error for a column whose
+// text does not fit Arrow's signed 32-bit offsets.
+inline void writeArrowStream(const ColumnarResult& result, std::string& out) {
+    detail::appendArrowMessage(out, detail::arrowSchemaMessage(result), "");
+
+    std::string body;
+    std::vector<std::pair<int64_t, int64_t>> buffers;
+    auto add_buffer = [&](const char* data, size_t length) {
+        buffers.push_back({static_cast<int64_t>(body.size()), static_cast<int64_t>(length)});
+        body.append(data, length);
+        detail::padTo(body, 8);
+    };
+    for (const auto& column : result.columns) {
+        if (column.type == ColumnType::UTF8) detail::checkTextColumn(column, result.row_count, INT32_MAX);
+    }
+    for (const auto& column : result.columns) {
+        std::string encoded;
+        if (!column.nulls.empty()) detail::appendBitmap(encoded, column.nulls, false);
+        add_buffer(encoded.data(), encoded.size()); // validity
+        encoded.clear();
+        if (column.type == ColumnType::FLOAT64) {
+            for (double value : column.numbers) detail::putLE<double>(encoded, value);
+            add_buffer(encoded.data(), encoded.size());
+        } else {
+            for (uint32_t offset : column.offsets) detail::putLE<int32_t>(encoded, static_cast<int32_t>(offset));
+            add_buffer(encoded.data(), encoded.size());
+            add_buffer(column.text.data(), column.text.size());
+        }
+    }
+    detail::appendArrowMessage(out, detail::arrowRecordBatchMessage(result, body.size(), buffers), body);
+
+    detail::putLE<uint32_t>(out, 0xFFFFFFFFu);
+    detail::putLE<uint32_t>(out, 0);
+}
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,237 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+#include <cmath>
+#include <charconv>
+#include <stdexcept>
+#include <algorithm>
+#include "executor.hpp"
+#include "../utils/string_utils.hpp"
+
+namespace aqe {
+namespace query {
+
+enum class OutputFormat {
+    TABLE,      // aligned columns for a terminal
+    CSV,        // RFC 4180 quoting
+    TSV,        // tab-separated, with backslash escapes for tab, newline and backslash
+    JSON_LINES  // one JSON object per row, numbers unquoted, "NULL" as null
+};
+
+// Parses "table", "csv", "tsv" or "json"/"jsonl". Throws std::invalid_argument.
+inline OutputFormat parseOutputFormat(std::string_view name) {
+    if (name == "table") return OutputFormat::TABLE;
+    if (name == "csv") return OutputFormat::CSV;
+    if (name == "tsv") return OutputFormat::TSV;
+    if (name == "json" || name == "jsonl") return OutputFormat::JSON_LINES;
+    throw std::invalid_argument("Unknown output format '" + std::string(name) + "'");
+}
+
+// Formats results into one caller-owned buffer instead of streaming cells
+// through iostream manipulators, so printing a large result costs one pass of
+// to_chars and a single write rather than a flush per line. Numbers come
+// straight from the result's native values; getRows() is never called.
+class ResultWriter {
+public:
+    explicit ResultWriter(OutputFormat output_format = OutputFormat::TABLE) : format(output_format) {}
+
+    OutputFormat outputFormat() const { return format; }
+
+    // Appends `result` to `out` in this writer's format.
+    void append(const QueryResult& result, std::string& out) const {
+        const auto& headers = result.getColumnNames();
+        if (headers.empty()) return;
+        switch (format) {
+            case OutputFormat::TABLE: appendTable(result, out); break;
+            case OutputFormat::CSV: appendDelimited(result, ',', out); break;
+            case OutputFormat::TSV: appendDelimited(result, '\t', out); break;
+            case OutputFormat::JSON_LINES: appendJsonLines(result, out); break;
+        }
+    }
+
+    // Formats `result` and writes it to `stream` in one call.
+    void write(const QueryResult& result, std::FILE* stream = stdout) const {
+        std::string out;
+        append(result, out);
+        flush(out, stream);
+    }
+
+    static void flush(const std::string& out, std::FILE* stream = stdout) {
+        if (std::fwrite(out.data(), 1, out.size(), stream) != out.size()) {
+            throw std::runtime_error("Failed to write results");
+        }
+        std::fflush(stream);
+    }
+
+private:
+    OutputFormat format;
+
+    static void appendCell(const Value& value, std::string& out) {
+        if (const double* number = std::get_if<double>(&value)) {
+            utils::appendFixed(out, *number);
+        } else {
+            out += std::get<std::string>(value);
+        }
+    }
+
+    // Cells are formatted once into a scratch buffer to measure column widths,
+    // then copied out padded.
+    static void appendTable(const QueryResult& result, std::string& out) {
+        const auto& headers = result.getColumnNames();
+        const auto& rows = result.getValues();
+        size_t num_columns = headers.size();
+
+        std::string cells;
+        std::vector<size_t> ends;
+        ends.reserve(rows.size() * num_columns);
+        std::vector<size_t> widths;
+        for (const auto& header : headers) widths.push_back(header.size());
+        for (const auto& row : rows) {
+            for (size_t c = 0; c < num_columns; ++c) {
+                size_t start = cells.size();
+                if (c < row.size()) appendCell(row[c], cells);
+                ends.push_back(cells.size());
+                widths[c] = std::max(widths[c], cells.size() - start);
+            }
+        }
+
+        size_t line_width = 1;
+        for (size_t width : widths) line_width += width + 2;
+        out.reserve(out.size() + line_width * (rows.size() + 2) + 40);
+
+        auto pad = [&](size_t column, size_t length) { out.append(widths[column] + 2 - length, ' '); };
+        for (size_t c = 0; c < num_columns; ++c) {
+            out += headers[c];
+            pad(c, headers[c].size());
+        }
+        out.push_back('\n');
+        for (size_t width : widths) out.append(width + 2, '-');
+        out.push_back('\n');
+
+        size_t start = 0;
+        for (size_t r = 0; r < rows.size(); ++r) {
+            for (size_t c = 0; c < num_columns; ++c) {
+                size_t end = ends[r * num_columns + c];
+                out.append(cells, start, end - start);
+                pad(c, end - start);
+                start = end;
+            }
+            out.push_back('\n');
+        }
+
+        if (result.isApproximate()) {
+            out += "\nNote: Results are approximate.\n";
+        }
+    }
+
+    static void appendField(std::string_view text, char delimiter, std::string& out) {
+        if (delimiter == ',') {
+            if (text.find_first_of(",\"\r\n") == std::string_view::npos) {
+                out += text;
+                return;
+            }
+            out.push_back('"');
+            for (char ch : text) {
+                if (ch == '"') out.push_back('"');
+                out.push_back(ch);
+            }
+            out.push_back('"');
+            return;
+        }
+        for (char ch : text) {
+            switch (ch) {
+                case '\t': out += "\\t"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\\': out += "\\\\"; break;
+                default: out.push_back(ch);
+            }
+        }
+    }
+
+    static void appendDelimited(const QueryResult& result, char delimiter, std::string& out) {
+        const auto& headers = result.getColumnNames();
+        for (size_t c = 0; c < headers.size(); ++c) {
+            if (c > 0) out.push_back(delimiter);
+            appendField(headers[c], delimiter, out);
+        }
+        out.push_back('\n');
+        for (const auto& row : result.getValues()) {
+            for (size_t c = 0; c < row.size(); ++c) {
+                if (c > 0) out.push_back(delimiter);
+                if (const double* number = std::get_if<double>(&row[c])) {
+                    utils::appendFixed(out, *number);
+                } else {
+                    appendField(std::get<std::string>(row[c]), delimiter, out);
+                }
+            }
+            out.push_back('\n');
+        }
+    }
+
+    static void appendJsonString(std::string_view text, std::string& out) {
+        static const char* hex = "0123456789abcdef";
+        out.push_back('"');
+        for (char ch : text) {
+            switch (ch) {
+                case '"': out += "\\\""; break;
+                case '\\': out += "\\\\"; break;
+                case '\n': out += "\\n"; break;
+                case '\r': out += "\\r"; break;
+                case '\t': out += "\\t"; break;
+                default:
+                    if (static_cast<unsigned char>(ch) < 0x20) {
+                        out += "\\u00";
+                        out.push_back(hex[(ch >> 4) & 0xF]);
+                        out.push_back(hex[ch & 0xF]);
+                    } else {
+                        out.push_back(ch);
+                    }
+            }
+        }
+        out.push_back('"');
+    }
+
+    // Integral numbers are written as integers and others in the shortest
+    // form that round-trips; NaN and infinities, which JSON cannot represent,
+    // become null.
+    static void appendJsonNumber(double value, std::string& out) {
+        if (!std::isfinite(value)) {
+            out += "null";
+            return;
+        }
+        char buffer[32];
+        if (value == std::trunc(value) && std::fabs(value) < 9007199254740992.0) { // 2^53
+            out.append(buffer, std::to_chars(buffer, buffer + sizeof(buffer), static_cast<long long>(value)).ptr);
+            return;
+        }
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, ec == std::errc() ? end : buffer);
+    }
+
+    static void appendJsonLines(const QueryResult& result, std::string& out) {
+        const auto& headers = result.getColumnNames();
+        for (const auto& row : result.getValues()) {
+            out.push_back('{');
+            for (size_t c = 0; c < row.size() && c < headers.size(); ++c) {
+                if (c > 0) out.push_back(',');
+                appendJsonString(headers[c], out);
+                out.push_back(':');
+                if (const double* number = std::get_if<double>(&row[c])) {
+                    appendJsonNumber(*number, out);
+                } else if (std::get<std::string>(row[c]) == "NULL") {
+                    out += "null";
+                } else {
+                    appendJsonString(std::get<std::string>(row[c]), out);
+                }
+            }
+            out += "}\n";
+        }
+    }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,246 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include "data_row.hpp"
+#include "zone_map.hpp"
+
+namespace aqe {
+namespace query {
+
+// A block of table rows with a capacity fixed when it is created. Rows are
+// only ever added at the end, by one writer at a time, and never past the
+// capacity, so they never move: the rows below a count that has been
+// published to readers stay valid and unchanged while more are appended.
+class Segment {
+public:
+    explicit Segment(size_t row_capacity) : capacity(row_capacity) {
+        if (capacity == 0) throw std::invalid_argument("Segments need room for at least one row");
+        rows.reserve(capacity);
+    }
+
+    // A full segment holding `loaded`.
+    explicit Segment(std::vector<DataRow>&& loaded) : rows(std::move(loaded)), capacity(rows.size()) {}
+
+    const DataRow* data() const { return rows.data(); }
+    size_t getCapacity() const { return capacity; }
+
+private:
+    friend class SegmentedRows;
+    std::vector<DataRow> rows; // writers only; readers go through data()
+    size_t capacity;
+};
+
+// A contiguous run of rows.
+struct RowSpan {
+    const DataRow* first = nullptr;
+    const DataRow* last = nullptr;
+
+    const DataRow* begin() const { return first; }
+    const DataRow* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+};
+
+// The rows a query reads, as contiguous spans in table order. Does not own
+// the rows.
+class RowSet {
+public:
+    RowSet() = default;
+    RowSet(const std::vector<DataRow>& rows) { add(rows.data(), rows.data() + rows.size()); }
+
+    void add(const DataRow* first, const DataRow* last) {
+        if (first == last) return;
+        spans.push_back(RowSpan{first, last});
+        row_count += static_cast<size_t>(last - first);
+    }
+
+    const std::vector<RowSpan>& getSpans() const { return spans; }
+    size_t size() const { return row_count; }
+    bool empty() const { return row_count == 0; }
+
+    // Calls fn(first, last) for consecutive runs of at most `batch_rows` rows.
+    template <typename Fn>
+    void forEachBatch(size_t batch_rows, Fn&& fn) const {
+        for (const auto& span : spans) {
+            for (const DataRow* start = span.first; start < span.last;) {
+                const DataRow* stop = span.last - start > static_cast<std::ptrdiff_t>(batch_rows)
+                                          ? start + batch_rows : span.last;
+                fn(start, stop);
+                start = stop;
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachRow(Fn&& fn) const {
+        for (const auto& span : spans) {
+            for (const DataRow& row : span) fn(row);
+        }
+    }
+
+private:
+    std::vector<RowSpan> spans;
+    size_t row_count = 0;
+};
+
+struct CompactionOptions {
+    // Sealed segments below this many rows are merged with their neighbours.
+    size_t small_segment_rows = 16384;
+    // Largest segment a merge produces.
+    size_t target_segment_rows = 65536;
+};
+
+// One version of a table's rows: a list of segments and how many rows of
+// each belong to this version. Versions share segments. Every segment but
+// the last is sealed; the last is the active append buffer, which later
+// versions may fill further in place without disturbing this one. Sealed
+// segments may carry a zone map that lets scans skip them.
+class SegmentedRows {
+public:
+    struct Part {
+        std::shared_ptr<Segment> segment;
+        size_t rows;
+        std::shared_ptr<const ZoneMap> zones; // null until compacted
+    };
+
+    // A rewrite of the leading sealed parts of one version, planned without
+    // the writer lock and applied with compacted().
+    struct Compaction {
+        size_t replaced_parts = 0;
+        std::vector<Part> parts;
+        size_t merged_segments = 0; // segments folded into others
+
+        bool empty() const { return replaced_parts == 0; }
+    };
+
+    SegmentedRows() = default;
+
+    // Takes over `rows` as one sealed segment.
+    static SegmentedRows fromRows(std::vector<DataRow>&& rows) {
+        SegmentedRows result;
+        if (rows.empty()) return result;
+        size_t count = rows.size();
+        result.parts.push_back(Part{std::make_shared<Segment>(std::move(rows)), count, nullptr});
+        result.row_count = count;
+        return result;
+    }
+
+    // A later version holding this one's rows followed by [begin, end).
+    // Rows go into the active buffer; a full buffer is sealed and a new one
+    // of `buffer_rows` capacity started. Must only be called on the newest
+    // version, by the single writer.
+    template <typename Iterator>
+    SegmentedRows appended(Iterator begin, Iterator end, size_t buffer_rows) const {
+        SegmentedRows next = *this;
+        for (auto it = begin; it != end; ++it) {
+            if (next.parts.empty() || next.parts.back().rows == next.parts.back().segment->capacity) {
+                next.parts.push_back(Part{std::make_shared<Segment>(buffer_rows), 0, nullptr});
+            }
+            Part& active = next.parts.back();
+            if (active.segment->rows.size() != active.rows) {
+                throw std::logic_error("Rows appended to a segment from an older version");
+            }
+            active.segment->rows.push_back(*it);
+            ++active.rows;
+            ++next.row_count;
+        }
+        return next;
+    }
+
+    RowSet rowSet() const {
+        RowSet set;
+        for (const auto& part : parts) set.add(part.segment->data(), part.segment->data() + part.rows);
+        return set;
+    }
+
+    // The rows of the parts whose zone map `keep` accepts. Parts without a
+    // zone map are always read.
+    template <typename Keep>
+    RowSet rowSet(Keep&& keep) const {
+        RowSet set;
+        for (const auto& part : parts) {
+            if (part.zones && !keep(*part.zones)) continue;
+            set.add(part.segment->data(), part.segment->data() + part.rows);
+        }
+        return set;
+    }
+
+    // Plans merging small sealed segments with their neighbours into
+    // exactly-sized segments of up to target_segment_rows rows, and a zone
+    // map for every sealed segment. Only reads sealed segments, so it may run
+    // on any version while the writer appends. Empty if there is nothing to do.
+    Compaction planCompaction(const CompactionOptions& options) const {
+        if (options.target_segment_rows == 0) {
+            throw std::invalid_argument("Compacted segments need room for at least one row");
+        }
+        size_t sealed = 0;
+        while (sealed < parts.size() && parts[sealed].rows == parts[sealed].segment->capacity) ++sealed;
+
+        Compaction plan;
+        bool changed = false;
+        for (size_t i = 0; i < sealed;) {
+            // A run grows while it fits and one side of each join is small
+            size_t run_end = i + 1;
+            size_t run_rows = parts[i].rows;
+            while (run_end < sealed && run_rows + parts[run_end].rows <= options.target_segment_rows &&
+                   (parts[run_end - 1].rows < options.small_segment_rows ||
+                    parts[run_end].rows < options.small_segment_rows)) {
+                run_rows += parts[run_end].rows;
+                ++run_end;
+            }
+            if (run_end - i == 1) {
+                Part part = parts[i];
+                if (!part.zones) {
+                    const DataRow* first = part.segment->data();
+                    part.zones = std::make_shared<const ZoneMap>(ZoneMap::build(first, first + part.rows));
+                    changed = true;
+                }
+                plan.parts.push_back(std::move(part));
+            } else {
+                std::vector<DataRow> merged;
+                merged.reserve(run_rows);
+                for (size_t k = i; k < run_end; ++k) {
+                    const DataRow* first = parts[k].segment->data();
+                    merged.insert(merged.end(), first, first + parts[k].rows);
+                }
+                auto zones = std::make_shared<const ZoneMap>(ZoneMap::build(merged.data(), merged.data() + run_rows));
+                plan.parts.push_back(Part{std::make_shared<Segment>(std::move(merged)), run_rows, std::move(zones)});
+                plan.merged_segments += run_end - i - 1;
+                changed = true;
+            }
+            i = run_end;
+        }
+        if (!changed) return Compaction();
+        plan.replaced_parts = sealed;
+        return plan;
+    }
+
+    // This version with `plan`, made from `base`, applied. Empty if this
+    // version no longer starts with the segments the plan replaces.
+    std::optional<SegmentedRows> compacted(const SegmentedRows& base, Compaction plan) const {
+        if (plan.replaced_parts > parts.size() || plan.replaced_parts > base.parts.size()) return std::nullopt;
+        for (size_t i = 0; i < plan.replaced_parts; ++i) {
+            if (parts[i].segment != base.parts[i].segment || parts[i].rows != base.parts[i].rows) return std::nullopt;
+        }
+        SegmentedRows next;
+        next.parts = std::move(plan.parts);
+        next.parts.insert(next.parts.end(), parts.begin() + static_cast<std::ptrdiff_t>(plan.replaced_parts),
+                          parts.end());
+        next.row_count = row_count;
+        return next;
+    }
+
+    const std::vector<Part>& getParts() const { return parts; }
+    size_t size() const { return row_count; }
+    size_t segmentCount() const { return parts.size(); }
+
+private:
+    std::vector<Part> parts;
+    size_t row_count = 0;
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <exception>
+#include "executor.hpp"
+#include "planner.hpp"
+
+namespace aqe {
+namespace query {
+
+// Runs a set of plans over the same table with one cooperative pass: each
+// batch of rows is fed to every scanning query's pipeline while it is still
+// in cache, instead of scanning the table once per query. Plans answered
+// without a scan (statistics, sketch, cube) are run directly. Results are
+// returned in the order of `plans`; all plans must read `data`.
+//
+// A plan that fails (cancelled, timed out or invalid) leaves a null result
+// and its exception in `errors`, and only its pipeline leaves the scan; the
+// other plans keep sharing it.
+inline std::vector<std::unique_ptr<QueryResult>> executeShared(const std::vector<PhysicalPlan>& plans,
+                                                               const RowSet& data,
+                                                               std::vector<std::exception_ptr>& errors) {
+    std::vector<std::unique_ptr<QueryResult>> results(plans.size());
+    std::vector<std::unique_ptr<QueryPipeline>> pipelines(plans.size());
+    errors.assign(plans.size(), nullptr);
+    size_t scanning = 0;
+
+    for (size_t i = 0; i < plans.size(); ++i) {
+        try {
+            if (plans[i].query->join) {
+                throw std::invalid_argument("Join queries cannot share a single-table scan");
+            }
+            results[i] = QueryExecutor::executeWithoutScan(plans[i]);
+            if (!results[i] && plans[i].query->hasWindowFunctions()) {
+                // Windows sort whole partitions and cannot consume batches
+                results[i] = QueryExecutor().execute(plans[i], data);
+            } else if (!results[i]) {
+                pipelines[i] = std::make_unique<QueryPipeline>(plans[i]);
+                ++scanning;
+            }
+        } catch (...) {
+            errors[i] = std::current_exception();
+        }
+    }
+
+    auto drop = [&](size_t i) {
+        errors[i] = std::current_exception();
+        pipelines[i].reset();
+        --scanning;
+    };
+    if (scanning > 0) {
+        data.forEachBatch(QueryExecutor::BATCH_SIZE, [&](const DataRow* begin, const DataRow* end) {
+            if (scanning == 0) return;
+            for (size_t i = 0; i < pipelines.size(); ++i) {
+                if (!pipelines[i]) continue;
+                try {
+                    pipelines[i]->consume(begin, end);
+                } catch (...) {
+                    drop(i);
+                }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < plans.size(); ++i) {
+        if (!pipelines[i]) continue;
+        try {
+            results[i] = pipelines[i]->finish();
+        } catch (...) {
+            drop(i);
+        }
+    }
+    return results;
+}
+
+// As above, but throws the first plan's error instead of returning it.
+inline std::vector<std::unique_ptr<QueryResult>> executeShared(const std::vector<PhysicalPlan>& plans,
+                                                               const RowSet& data) {
+    std::vector<std::exception_ptr> errors;
+    auto results = executeShared(plans, data, errors);
+    for (const auto& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+    return results;
+}
+
+} // namespace query
+} // namespace aqe
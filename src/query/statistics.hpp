@@ -0,0 +1,108 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cctype>
+#include <charconv>
+#include <unordered_map>
+#include "data_row.hpp"
+#include "../core/data_structures.hpp"
+#include "../core/sketching.hpp"
+
+namespace aqe {
+namespace query {
+
+// Parses a cell as a number the way std::stod does: leading whitespace and
+// a '+' sign are skipped and a numeric prefix is enough, so " 12" and "12ms"
+// both read as 12. Returns false for empty or non-numeric text and for values
+// out of double range. Unlike stod, hexadecimal ("0x1A") is not recognised.
+inline bool parseNumber(const std::string& text, double& out) {
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+    while (begin != end && std::isspace(static_cast<unsigned char>(*begin))) ++begin;
+    if (begin != end && *begin == '+') {
+        ++begin;
+        if (begin != end && *begin == '-') return false;
+    }
+    return std::from_chars(begin, end, out).ec == std::errc();
+}
+
+struct ColumnStatistics {
+    size_t non_null_count = 0;
+    size_t numeric_count = 0;
+    double distinct_estimate = 0.0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    std::shared_ptr<core::CountMinSketch> frequencies;
+    std::shared_ptr<core::HyperLogLog> distinct; // kept so appends can extend distinct_estimate
+
+    bool isNumeric() const { return non_null_count > 0 && numeric_count == non_null_count; }
+};
+
+// Per-table statistics the planner consults: exact row count, and per column
+// a distinct-value estimate (HyperLogLog), numeric range and a Count-Min
+// Sketch of value frequencies. Computed when the table is loaded; each
+// append extends a clone().
+class TableStatistics {
+public:
+    size_t row_count = 0;
+    std::unordered_map<std::string, ColumnStatistics> columns;
+
+    static TableStatistics compute(const std::vector<DataRow>& data) {
+        TableStatistics stats;
+        stats.add(data.begin(), data.end());
+        return stats;
+    }
+
+    // A copy with sketches of its own, which can be extended while readers
+    // still use this one.
+    TableStatistics clone() const {
+        TableStatistics copy = *this;
+        for (auto& [name, col] : copy.columns) {
+            if (col.frequencies) col.frequencies = std::make_shared<core::CountMinSketch>(*col.frequencies);
+            if (col.distinct) col.distinct = std::make_shared<core::HyperLogLog>(*col.distinct);
+        }
+        return copy;
+    }
+
+    // Folds rows into the statistics, as if they had been part of the table
+    // when compute() ran.
+    template <typename Iterator>
+    void add(Iterator begin, Iterator end) {
+        for (auto it = begin; it != end; ++it) {
+            ++row_count;
+            for (const auto& [name, value] : it->values) {
+                ColumnStatistics& col = columns[name];
+                if (!col.frequencies) {
+                    col.frequencies = std::make_shared<core::CountMinSketch>();
+                    col.distinct = std::make_shared<core::HyperLogLog>();
+                }
+                if (value.empty()) continue;
+
+                ++col.non_null_count;
+                col.frequencies->add(value);
+                col.distinct->add(value);
+                double number;
+                if (parseNumber(value, number)) {
+                    ++col.numeric_count;
+                    col.min = std::min(col.min, number);
+                    col.max = std::max(col.max, number);
+                }
+            }
+        }
+
+        for (auto& [name, col] : columns) {
+            if (col.non_null_count > 0) col.distinct_estimate = col.distinct->estimate();
+        }
+    }
+
+    const ColumnStatistics* column(const std::string& name) const {
+        auto it = columns.find(name);
+        return it == columns.end() ? nullptr : &it->second;
+    }
+};
+
+} // namespace query
+} // namespace aqe
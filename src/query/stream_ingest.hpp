@@ -0,0 +1,244 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <thread>
+#include <iterator>
+#include <optional>
+#include <exception>
+#include <stdexcept>
+#include "catalog.hpp"
+#include "../core/ring_buffer.hpp"
+#include "../utils/string_utils.hpp"
+
+namespace aqe {
+namespace query {
+
+struct IngestOptions {
+    // Rows gathered before a micro-batch is appended.
+    size_t batch_rows = 10000;
+    // Longest a parsed row waits for its batch to fill before the batch is
+    // appended anyway, checked as each line arrives.
+    std::chrono::milliseconds max_delay{200};
+    // Threads turning lines into rows. With more than one, rows read by
+    // different threads may be appended out of input order.
+    size_t parser_threads = 1;
+    // Parsed batches waiting for the committer before parsers stall.
+    size_t queue_batches = 64;
+};
+
+// Appends CSV lines read from a stream (a pipe, FIFO or growing file) to a
+// catalog table in micro-batches, so queries running meanwhile see new rows
+// a batch at a time. If the table does not exist yet, the first line names
+// its columns; otherwise a first line equal to the table's column names is
+// skipped.
+//
+// Parser threads take turns reading lines, parse them into row batches off
+// the input lock and push the batches into a lock-free ring. The thread that
+// calls run() is the single committer: it drains the ring and appends what
+// it finds as one micro-batch whenever it has batch_rows rows or has caught
+// up with the parsers, and sleeps on a condition variable the parsers signal
+// after each push, so an idle stream costs no wakeups. A parser ends its
+// batch when it is full, when it has waited max_delay, or when no further
+// input is buffered.
+class StreamIngestor {
+public:
+    StreamIngestor(Catalog& target, std::string table_name, IngestOptions ingest_options = IngestOptions())
+        : catalog(target), table(std::move(table_name)), options(ingest_options) {
+        if (options.batch_rows == 0) {
+            throw std::invalid_argument("Ingest batches need at least one row");
+        }
+        if (options.parser_threads == 0 || options.queue_batches == 0) {
+            throw std::invalid_argument("Ingest needs at least one parser thread and one queued batch");
+        }
+    }
+
+    // Reads until end of input or stop(). Returns the rows appended.
+    size_t run(std::istream& in) {
+        Queue queue(options.queue_batches);
+        std::vector<std::string> columns = readSchema(in);
+
+        std::mutex input;
+        std::atomic<size_t> live_parsers{options.parser_threads};
+        std::vector<std::thread> parsers;
+        for (size_t i = 0; i < options.parser_threads; ++i) {
+            parsers.emplace_back([&] {
+                try {
+                    parse(in, input, columns, queue);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                live_parsers.fetch_sub(1, std::memory_order_release);
+                signalCommitter();
+            });
+        }
+
+        size_t appended = 0;
+        std::vector<DataRow> pending;
+        std::vector<DataRow> incoming;
+        uint64_t seen_signals = 0;
+        for (;;) {
+            // Read before draining: once no parser is live, everything they
+            // pushed is already visible.
+            bool finished = live_parsers.load(std::memory_order_acquire) == 0;
+            bool drained_any = false;
+            while (pending.size() < options.batch_rows && queue.tryPop(incoming)) {
+                drained_any = true;
+                if (pending.empty()) {
+                    pending = std::move(incoming);
+                } else {
+                    pending.insert(pending.end(), std::make_move_iterator(incoming.begin()),
+                                   std::make_move_iterator(incoming.end()));
+                }
+            }
+            if (!pending.empty()) {
+                try {
+                    if (!failed.load(std::memory_order_relaxed)) appended += commit(pending);
+                } catch (...) {
+                    fail(std::current_exception());
+                }
+                pending.clear();
+            }
+            if (drained_any) continue;
+            if (finished) break;
+            // Every push since the last wakeup was signalled after it, so
+            // nothing is left unseen when the counts match.
+            std::unique_lock<std::mutex> lock(wake_mutex);
+            wake.wait(lock, [&] { return wake_signals != seen_signals; });
+            seen_signals = wake_signals;
+        }
+        for (auto& parser : parsers) parser.join();
+        if (error) std::rethrow_exception(error);
+        return appended;
+    }
+
+    // Makes run() return once each parser finishes the line it is reading;
+    // callable from any thread.
+    void stop() { stopping.store(true, std::memory_order_relaxed); }
+
+    size_t rowsIngested() const { return rows_ingested.load(std::memory_order_relaxed); }
+    size_t batchesCommitted() const { return batches_committed.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Queue = core::MpscRingBuffer<std::vector<DataRow>>;
+
+    Catalog& catalog;
+    std::string table;
+    IngestOptions options;
+    std::atomic<bool> stopping{false};
+    std::atomic<size_t> rows_ingested{0};
+    std::atomic<size_t> batches_committed{0};
+    std::atomic<bool> failed{false};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    std::optional<std::string> first_row; // read with the header, parsed with the first batch
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    uint64_t wake_signals = 0; // pushes and parser exits, under wake_mutex
+
+    // The table's column names, creating the table from the first line if it
+    // does not exist yet. A first line that is data starts the first batch.
+    std::vector<std::string> readSchema(std::istream& in) {
+        std::vector<std::string> columns;
+        {
+            auto snapshot = catalog.snapshot();
+            if (const Table* existing = snapshot->find(table)) columns = existing->schema;
+        }
+        std::string line;
+        while (std::getline(in, line)) {
+            if (line.empty() || line == "\r") continue;
+            if (columns.empty()) {
+                columns = utils::splitCSV(line);
+                catalog.addTable(table, columns, {});
+            } else if (utils::splitCSV(line) != columns) {
+                first_row = std::move(line);
+            }
+            break;
+        }
+        return columns;
+    }
+
+    void parse(std::istream& in, std::mutex& input, const std::vector<std::string>& columns, Queue& queue) {
+        std::vector<std::string> lines;
+        bool more = true;
+        while (more && !stopping.load(std::memory_order_relaxed)) {
+            lines.clear();
+            {
+                std::lock_guard<std::mutex> lock(input);
+                more = readLines(in, lines);
+            }
+            if (lines.empty()) continue;
+            std::vector<DataRow> batch;
+            batch.reserve(lines.size());
+            for (const auto& line : lines) batch.push_back(parseRow(columns, line));
+            queue.push(std::move(batch));
+            signalCommitter();
+        }
+    }
+
+    void signalCommitter() {
+        {
+            std::lock_guard<std::mutex> lock(wake_mutex);
+            ++wake_signals;
+        }
+        wake.notify_one();
+    }
+
+    // Reads the lines of one batch. Returns false at end of input.
+    bool readLines(std::istream& in, std::vector<std::string>& lines) {
+        Clock::time_point started = Clock::now();
+        std::string line;
+        if (first_row) {
+            lines.push_back(std::move(*first_row));
+            first_row.reset();
+        }
+        while (!stopping.load(std::memory_order_relaxed)) {
+            if (!std::getline(in, line)) return false;
+            if (line.empty() || line == "\r") continue;
+            if (lines.empty()) started = Clock::now();
+            lines.push_back(std::move(line));
+            if (lines.size() >= options.batch_rows || in.rdbuf()->in_avail() <= 0 ||
+                Clock::now() - started >= options.max_delay) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static DataRow parseRow(const std::vector<std::string>& columns, const std::string& line) {
+        DataRow row;
+        auto values = utils::splitCSV(line);
+        for (size_t i = 0; i < columns.size() && i < values.size(); ++i) {
+            row.values[columns[i]] = std::move(values[i]);
+        }
+        return row;
+    }
+
+    size_t commit(std::vector<DataRow>& batch) {
+        size_t count = catalog.appendRows(table, std::move(batch));
+        rows_ingested.fetch_add(count, std::memory_order_relaxed);
+        batches_committed.fetch_add(1, std::memory_order_relaxed);
+        return count;
+    }
+
+    // Keeps the first error and stops the parsers; the committer keeps
+    // draining so none of them stays blocked on a full queue.
+    void fail(std::exception_ptr exception) {
+        {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) error = exception;
+        }
+        failed.store(true, std::memory_order_relaxed);
+        stopping.store(true, std::memory_order_relaxed);
+    }
+};
+
+} // namespace query
+} // namespace aqe
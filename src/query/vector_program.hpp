@@ -0,0 +1,159 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include "data_row.hpp"
+#include "expression.hpp"
+#include "statistics.hpp"
+
+namespace aqe {
+namespace query {
+
+// An aggregate input compiled to a straight-line program of column-at-a-time
+// operations. Each instruction fills one register (a buffer with a value and
+// a validity flag per row of the batch) from the registers before it, so a
+// batch is walked once per operator rather than once per row through the
+// expression tree. A plain column compiles to a single LOAD.
+//
+// A row's result is invalid (skipped by the aggregate, like any non-numeric
+// value) if a column it reads is missing or non-numeric, or if it divides by
+// zero.
+class VectorProgram {
+public:
+    enum class OpCode { LOAD, CONSTANT, ADD, SUBTRACT, MULTIPLY, DIVIDE, NEGATE };
+
+    struct Instruction {
+        OpCode op;
+        size_t left = 0;  // operand registers
+        size_t right = 0;
+        std::string column;
+        double constant = 0.0;
+    };
+
+    static VectorProgram compileColumn(const std::string& column) {
+        VectorProgram program;
+        program.code.push_back({OpCode::LOAD, 0, 0, column, 0.0});
+        program.registers.resize(1);
+        return program;
+    }
+
+    static VectorProgram compile(const Expression& expression) {
+        VectorProgram program;
+        program.emit(expression);
+        program.registers.resize(program.code.size());
+        return program;
+    }
+
+    const std::vector<Instruction>& instructions() const { return code; }
+
+    // Evaluates the program over `rows` and returns the result register,
+    // valid until the next call.
+    struct Result {
+        const std::vector<double>& values;
+        const std::vector<uint8_t>& valid;
+    };
+
+    Result evaluate(const std::vector<const DataRow*>& rows) {
+        size_t n = rows.size();
+        for (size_t r = 0; r < code.size(); ++r) {
+            const Instruction& ins = code[r];
+            Register& out = registers[r];
+            out.values.resize(n);
+            out.valid.resize(n);
+            double* value = out.values.data();
+            uint8_t* valid = out.valid.data();
+
+            switch (ins.op) {
+                case OpCode::LOAD:
+                    for (size_t i = 0; i < n; ++i) {
+                        auto it = rows[i]->values.find(ins.column);
+                        valid[i] = it != rows[i]->values.end() && parseNumber(it->second, value[i]);
+                    }
+                    break;
+                case OpCode::CONSTANT:
+                    std::fill(value, value + n, ins.constant);
+                    std::fill(valid, valid + n, uint8_t{1});
+                    break;
+                case OpCode::NEGATE: {
+                    const Register& a = registers[ins.left];
+                    for (size_t i = 0; i < n; ++i) value[i] = -a.values[i];
+                    std::copy(a.valid.begin(), a.valid.begin() + n, valid);
+                    break;
+                }
+                default:
+                    binary(ins, out, n);
+                    break;
+            }
+        }
+        return {registers.back().values, registers.back().valid};
+    }
+
+private:
+    struct Register {
+        std::vector<double> values;
+        std::vector<uint8_t> valid;
+    };
+
+    std::vector<Instruction> code;
+    std::vector<Register> registers; // one per instruction, reused across batches
+
+    size_t emit(const Expression& e) {
+        Instruction ins{OpCode::CONSTANT, 0, 0, std::string(), 0.0};
+        switch (e.kind) {
+            case Expression::Kind::COLUMN:
+                ins.op = OpCode::LOAD;
+                ins.column = e.column;
+                break;
+            case Expression::Kind::NUMBER:
+                ins.constant = e.number;
+                break;
+            case Expression::Kind::NEGATE:
+                ins.op = OpCode::NEGATE;
+                ins.left = emit(e.operands[0]);
+                break;
+            default:
+                ins.op = e.kind == Expression::Kind::ADD ? OpCode::ADD
+                       : e.kind == Expression::Kind::SUBTRACT ? OpCode::SUBTRACT
+                       : e.kind == Expression::Kind::MULTIPLY ? OpCode::MULTIPLY : OpCode::DIVIDE;
+                ins.left = emit(e.operands[0]);
+                ins.right = emit(e.operands[1]);
+                break;
+        }
+        code.push_back(std::move(ins));
+        return code.size() - 1;
+    }
+
+    // Tight loops with no per-row dispatch, so the compiler can vectorize them.
+    void binary(const Instruction& ins, Register& out, size_t n) const {
+        const double* a = registers[ins.left].values.data();
+        const double* b = registers[ins.right].values.data();
+        const uint8_t* a_valid = registers[ins.left].valid.data();
+        const uint8_t* b_valid = registers[ins.right].valid.data();
+        double* value = out.values.data();
+        uint8_t* valid = out.valid.data();
+
+        switch (ins.op) {
+            case OpCode::ADD:
+                for (size_t i = 0; i < n; ++i) value[i] = a[i] + b[i];
+                break;
+            case OpCode::SUBTRACT:
+                for (size_t i = 0; i < n; ++i) value[i] = a[i] - b[i];
+                break;
+            case OpCode::MULTIPLY:
+                for (size_t i = 0; i < n; ++i) value[i] = a[i] * b[i];
+                break;
+            case OpCode::DIVIDE:
+                for (size_t i = 0; i < n; ++i) value[i] = b[i] != 0.0 ? a[i] / b[i] : 0.0;
+                for (size_t i = 0; i < n; ++i) valid[i] = a_valid[i] & b_valid[i] & (b[i] != 0.0);
+                return;
+            default:
+                break;
+        }
+        for (size_t i = 0; i < n; ++i) valid[i] = a_valid[i] & b_valid[i];
+    }
+};
+
+} // namespace query
+} // namespace aqe
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include <limits>
+#include "data_row.hpp"
+#include "segment.hpp"
+#include "parser.hpp"
+#include "predicate.hpp"
+#include "statistics.hpp"
+#include "cancellation.hpp"
+
+namespace aqe {
+namespace query {
+
+// Evaluates a query whose select list holds plain columns and window
+// functions. Rows passing WHERE are split into partitions, each partition is
+// sorted on the window's ORDER BY keys, and every window function is then
+// computed in one linear pass over its partition. Output rows come in the
+// partition-then-sort order of the first window column, unless the query has
+// its own ORDER BY; LIMIT applies last. A cancellation token is checked
+// while filtering and before each window column.
+class WindowOperator {
+public:
+    // Computed numbers stay doubles until the result is formatted.
+    using Rows = std::vector<std::vector<Value>>;
+
+    // Rows filtered between cancellation checks.
+    static constexpr size_t CHECK_INTERVAL = 4096;
+
+    static Rows run(const Query& query, const RowSet& data, const CancellationToken* cancellation = nullptr) {
+        std::vector<const DataRow*> input;
+        data.forEachBatch(CHECK_INTERVAL, [&](const DataRow* begin, const DataRow* end) {
+            if (cancellation) cancellation->throwIfCancelled();
+            for (const DataRow* row = begin; row != end; ++row) {
+                if (!query.where || matchesPredicate(*query.where, *row)) input.push_back(row);
+            }
+        });
+
+        Rows output(input.size(), std::vector<Value>(query.columns.size()));
+        std::vector<size_t> order;
+        for (size_t c = 0; c < query.columns.size(); ++c) {
+            const Column& col = query.columns[c];
+            if (!col.window) {
+                for (size_t r = 0; r < input.size(); ++r) output[r][c] = valueOf(*input[r], col.name);
+                continue;
+            }
+            if (cancellation) cancellation->throwIfCancelled();
+            std::vector<size_t> sorted = partitionAndSort(*col.window, input);
+            evaluate(*col.window, col.name, input, sorted, output, c);
+            if (order.empty()) order = std::move(sorted);
+        }
+
+        Rows result;
+        result.reserve(input.size());
+        for (size_t r : order) result.push_back(std::move(output[r]));
+        orderAndLimit(query, result);
+        return result;
+    }
+
+private:
+    // A sort key read once per row: numeric when the value parses as a number.
+    struct Key {
+        bool numeric;
+        double number;
+        const std::string* text;
+    };
+
+    static const std::string& valueOf(const DataRow& row, const std::string& column) {
+        static const std::string null_value = "NULL";
+        auto it = row.values.find(column);
+        return it != row.values.end() ? it->second : null_value;
+    }
+
+    // Numbers sort before text; numbers compare numerically.
+    static int compareKeys(const Key& a, const Key& b) {
+        if (a.numeric != b.numeric) return a.numeric ? -1 : 1;
+        if (a.numeric) return a.number < b.number ? -1 : (a.number > b.number ? 1 : 0);
+        return a.text->compare(*b.text);
+    }
+
+    static Key makeKey(const std::string& value) {
+        Key key{false, 0.0, &value};
+        key.numeric = parseNumber(value, key.number);
+        return key;
+    }
+
+    static Key makeKey(const Value& value) {
+        if (const double* number = std::get_if<double>(&value)) return Key{true, *number, nullptr};
+        return makeKey(std::get<std::string>(value));
+    }
+
+    // Row indices grouped by partition (in first-seen order), each partition
+    // stably sorted on the window's ORDER BY keys.
+    static std::vector<size_t> partitionAndSort(const WindowSpec& window, const std::vector<const DataRow*>& input) {
+        std::unordered_map<std::string, size_t> partition_index;
+        std::vector<std::vector<size_t>> partitions;
+        std::string key;
+        for (size_t r = 0; r < input.size(); ++r) {
+            key.clear();
+            for (const auto& column : window.partition_by) {
+                key += valueOf(*input[r], column);
+                key.push_back('\x1f');
+            }
+            auto [it, inserted] = partition_index.try_emplace(key, partitions.size());
+            if (inserted) partitions.emplace_back();
+            partitions[it->second].push_back(r);
+        }
+
+        size_t num_keys = window.order_by.size();
+        std::vector<Key> keys(num_keys * input.size());
+        for (size_t r = 0; r < input.size() && num_keys > 0; ++r) {
+            for (size_t k = 0; k < num_keys; ++k) {
+                keys[r * num_keys + k] = makeKey(valueOf(*input[r], window.order_by[k].column));
+            }
+        }
+        auto before = [&](size_t a, size_t b) {
+            for (size_t k = 0; k < num_keys; ++k) {
+                int cmp = compareKeys(keys[a * num_keys + k], keys[b * num_keys + k]);
+                if (cmp != 0) return window.order_by[k].descending ? cmp > 0 : cmp < 0;
+            }
+            return false;
+        };
+
+        std::vector<size_t> sorted;
+        sorted.reserve(input.size());
+        for (auto& partition : partitions) {
+            if (num_keys > 0) std::stable_sort(partition.begin(), partition.end(), before);
+            sorted.insert(sorted.end(), partition.begin(), partition.end());
+            sorted.push_back(PARTITION_END);
+        }
+        return sorted;
+    }
+
+    static constexpr size_t PARTITION_END = std::numeric_limits<size_t>::max();
+
+    // One pass over `sorted`; a frame of ROWS n PRECEDING is kept as a sliding
+    // sum and count by subtracting the row that leaves it.
+    static void evaluate(const WindowSpec& window, const std::string& argument,
+                         const std::vector<const DataRow*>& input, std::vector<size_t>& sorted,
+                         Rows& output, size_t column) {
+        std::vector<double> values;
+        std::vector<bool> valid;
+        if (window.function != WindowFunction::ROW_NUMBER) {
+            values.resize(input.size());
+            valid.resize(input.size());
+            for (size_t r = 0; r < input.size(); ++r) {
+                double value = 0.0;
+                valid[r] = argument == "*" || parseNumber(valueOf(*input[r], argument), value);
+                values[r] = value;
+            }
+        }
+
+        size_t row_number = 0;
+        double sum = 0.0, min = 0.0, max = 0.0;
+        size_t count = 0;
+        for (size_t i = 0; i < sorted.size(); ++i) {
+            size_t r = sorted[i];
+            if (r == PARTITION_END) {
+                row_number = 0;
+                sum = 0.0;
+                count = 0;
+                continue;
+            }
+            ++row_number;
+            if (window.function == WindowFunction::ROW_NUMBER) {
+                output[r][column] = static_cast<double>(row_number);
+                continue;
+            }
+
+            if (valid[r]) {
+                sum += values[r];
+                min = count == 0 ? values[r] : std::min(min, values[r]);
+                max = count == 0 ? values[r] : std::max(max, values[r]);
+                ++count;
+            }
+            if (window.preceding && row_number > *window.preceding + 1) {
+                size_t leaving = sorted[i - *window.preceding - 1];
+                if (valid[leaving]) {
+                    sum -= values[leaving];
+                    --count;
+                }
+            }
+
+            Value& cell = output[r][column];
+            if (window.function == WindowFunction::COUNT) {
+                cell = static_cast<double>(count);
+            } else if (count == 0) {
+                cell = std::string("NULL");
+            } else {
+                cell = window.function == WindowFunction::SUM ? sum
+                     : window.function == WindowFunction::AVG ? sum / count
+                     : window.function == WindowFunction::MIN ? min : max;
+            }
+        }
+        sorted.erase(std::remove(sorted.begin(), sorted.end(), PARTITION_END), sorted.end());
+    }
+
+    static void orderAndLimit(const Query& query, Rows& rows) {
+        if (!query.order_by.empty()) {
+            std::stable_sort(rows.begin(), rows.end(), [&](const auto& a, const auto& b) {
+                for (const auto& item : query.order_by) {
+                    int cmp = compareKeys(makeKey(a[item.column_index]), makeKey(b[item.column_index]));
+                    if (cmp != 0) return item.descending ? cmp > 0 : cmp < 0;
+                }
+                return false;
+            });
+        }
+        if (query.limit && *query.limit < rows.size()) rows.resize(*query.limit);
+    }
+};
+
+} // namespace query
+} // namespace aqe
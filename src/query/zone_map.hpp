@@ -0,0 +1,89 @@
+#pragma once
+
+#include <string>
+#include <limits>
+#include <variant>
+#include <algorithm>
+#include <unordered_map>
+#include "data_row.hpp"
+#include "parser.hpp"
+#include "predicate.hpp"
+#include "statistics.hpp"
+
+namespace aqe {
+namespace query {
+
+// What a segment holds in one column: how many rows have a value, the
+// numeric range of those that parse as numbers and the lexicographic range
+// of all of them.
+struct ColumnZone {
+    size_t present = 0;
+    size_t numeric = 0;
+    double min = std::numeric_limits<double>::max();
+    double max = std::numeric_limits<double>::lowest();
+    std::string min_text;
+    std::string max_text;
+};
+
+// Per-column ranges of one sealed segment, so a scan can skip segments in
+// which no row can satisfy the WHERE clause. Follows matchesPredicate():
+// missing columns never match, numeric literals only match cells that parse
+// as numbers, and string literals compare as text.
+class ZoneMap {
+public:
+    static ZoneMap build(const DataRow* begin, const DataRow* end) {
+        ZoneMap zones;
+        for (const DataRow* row = begin; row != end; ++row) {
+            for (const auto& [name, value] : row->values) {
+                ColumnZone& zone = zones.columns[name];
+                if (zone.present == 0 || value < zone.min_text) zone.min_text = value;
+                if (zone.present == 0 || value > zone.max_text) zone.max_text = value;
+                ++zone.present;
+                double number;
+                if (parseNumber(value, number)) {
+                    ++zone.numeric;
+                    zone.min = std::min(zone.min, number);
+                    zone.max = std::max(zone.max, number);
+                }
+            }
+        }
+        return zones;
+    }
+
+    // False only if no row of the segment can satisfy `predicate`.
+    bool mayMatch(const Predicate& predicate) const {
+        return evaluatePredicate(predicate, [this](const Predicate& comparison) {
+            const ColumnZone* zone = column(comparison.column);
+            if (!zone || zone->present == 0) return false;
+            if (const double* number = std::get_if<double>(&comparison.value)) {
+                return zone->numeric > 0 && overlaps(comparison.op, zone->min, zone->max, *number);
+            }
+            return overlaps(comparison.op, zone->min_text, zone->max_text, std::get<std::string>(comparison.value));
+        });
+    }
+
+    const ColumnZone* column(const std::string& name) const {
+        auto it = columns.find(name);
+        return it == columns.end() ? nullptr : &it->second;
+    }
+
+private:
+    std::unordered_map<std::string, ColumnZone> columns;
+
+    // Whether some value in [low, high] compares true against `literal`.
+    template <typename T>
+    static bool overlaps(CompareOp op, const T& low, const T& high, const T& literal) {
+        switch (op) {
+            case CompareOp::EQ: return !(literal < low) && !(high < literal);
+            case CompareOp::NE: return low < literal || literal < high;
+            case CompareOp::LT: return low < literal;
+            case CompareOp::LE: return !(literal < low);
+            case CompareOp::GT: return literal < high;
+            case CompareOp::GE: return !(high < literal);
+        }
+        return true;
+    }
+};
+
+} // namespace query
+} // namespace aqe
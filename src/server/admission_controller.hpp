@@ -0,0 +1,199 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include "../query/catalog.hpp"
+
+namespace aqe {
+namespace server {
+
+// Interactive queries are approximate or answered without a full scan and are
+// expected back quickly; batch queries scan everything for an exact answer.
+enum class QueryPriority { INTERACTIVE, BATCH };
+
+inline QueryPriority priorityOf(const query::PhysicalPlan& plan) {
+    bool sampled = plan.query->sampling.method != query::SamplingMethod::NONE;
+    return sampled || plan.access != query::AccessPath::TABLE_SCAN ? QueryPriority::INTERACTIVE
+                                                                      : QueryPriority::BATCH;
+}
+
+// Rough upper bound on the memory a plan holds while it runs: its group
+// table (groups estimated from distinct counts), rows a reservoir or
+// stratified sample keeps, a join's build side, and window or projection
+// output. Only used to keep concurrent queries within a budget.
+inline size_t estimateMemory(const query::PhysicalPlan& plan, const query::CatalogVersion& catalog) {
+    constexpr size_t BASE_BYTES = 4096;
+    constexpr size_t ROW_BYTES = 256;         // a DataRow with a few short columns
+    constexpr size_t GROUP_KEY_BYTES = 48;    // per group-by column in a group key
+    constexpr size_t AGGREGATE_BYTES = 48;    // per aggregate accumulator
+    constexpr size_t OUTPUT_CELL_BYTES = 40;  // per output value
+
+    const query::Query& q = *plan.query;
+    if (plan.access != query::AccessPath::TABLE_SCAN) return BASE_BYTES;
+
+    const query::Table& source = catalog.table(q.table_name);
+    double rows = static_cast<double>(catalog.scanInput(plan).size());
+    size_t bytes = BASE_BYTES;
+    if (q.join) {
+        const query::Table& build = catalog.table(q.join->table);
+        bytes += build.rows.size() * (ROW_BYTES / 4 + sizeof(void*));
+    }
+    if (q.sampling.method == query::SamplingMethod::RESERVOIR) {
+        bytes += std::min<size_t>(q.sampling.size, static_cast<size_t>(rows)) * (q.join ? ROW_BYTES : sizeof(void*));
+    } else if (q.sampling.method == query::SamplingMethod::STRATIFIED) {
+        bytes += static_cast<size_t>(rows * q.sampling.rate) * (q.join ? ROW_BYTES : sizeof(void*));
+    }
+
+    if (q.hasWindowFunctions() || plan.aggregates.empty()) {
+        return bytes + static_cast<size_t>(rows) * (sizeof(void*) + q.columns.size() * OUTPUT_CELL_BYTES);
+    }
+    double groups = 1.0;
+    for (const auto& column : q.group_by_columns) {
+        auto it = source.statistics.columns.find(column);
+        groups *= it == source.statistics.columns.end() ? rows : std::max(1.0, it->second.distinct_estimate);
+        groups = std::min(groups, std::max(1.0, rows));
+    }
+    size_t per_group = q.group_by_columns.size() * GROUP_KEY_BYTES + plan.aggregates.size() * AGGREGATE_BYTES +
+                       q.columns.size() * OUTPUT_CELL_BYTES;
+    return bytes + static_cast<size_t>(groups) * per_group;
+}
+
+struct AdmissionLimits {
+    // Queries running at once; also the number of worker threads.
+    size_t max_in_flight = std::max(2u, std::thread::hardware_concurrency());
+    // Sum of estimateMemory() over running queries. A query estimated above
+    // the budget still runs, but only when nothing else is running.
+    size_t max_memory_bytes = size_t(1) << 30;
+};
+
+// Runs submitted jobs on a fixed set of worker threads, admitting a job only
+// while the in-flight and memory limits allow it. Interactive jobs are
+// admitted ahead of any waiting batch job, and when more than one query may
+// run, one slot is held back from batch jobs so an interactive query never
+// waits behind a full set of long scans. Jobs of one priority are admitted in
+// submission order.
+class AdmissionController {
+public:
+    struct Stats {
+        size_t in_flight = 0;
+        size_t memory_in_use = 0;
+        size_t queued_interactive = 0;
+        size_t queued_batch = 0;
+        size_t peak_in_flight = 0;
+    };
+
+    explicit AdmissionController(AdmissionLimits admission_limits = AdmissionLimits()) : limits(admission_limits) {
+        if (limits.max_in_flight == 0) {
+            throw std::invalid_argument("At least one query must be allowed in flight");
+        }
+        for (size_t i = 0; i < limits.max_in_flight; ++i) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    // Jobs still queued are dropped; running jobs finish first.
+    ~AdmissionController() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (auto& worker : workers) worker.join();
+    }
+
+    AdmissionController(const AdmissionController&) = delete;
+    AdmissionController& operator=(const AdmissionController&) = delete;
+
+    void submit(QueryPriority priority, size_t memory_bytes, std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queueFor(priority).push_back(Job{memory_bytes, std::move(job)});
+        }
+        changed.notify_all();
+    }
+
+    Stats stats() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        Stats s = counters;
+        s.queued_interactive = interactive.size();
+        s.queued_batch = batch.size();
+        return s;
+    }
+
+    const AdmissionLimits& getLimits() const { return limits; }
+
+private:
+    struct Job {
+        size_t memory_bytes;
+        std::function<void()> run;
+    };
+
+    AdmissionLimits limits;
+    mutable std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<Job> interactive;
+    std::deque<Job> batch;
+    Stats counters;
+    size_t batch_in_flight = 0;
+    bool stopping = false;
+    std::vector<std::thread> workers;
+
+    std::deque<Job>& queueFor(QueryPriority priority) {
+        return priority == QueryPriority::INTERACTIVE ? interactive : batch;
+    }
+
+    bool fits(const Job& job) const {
+        return counters.in_flight == 0 || counters.memory_in_use + job.memory_bytes <= limits.max_memory_bytes;
+    }
+
+    // The queue whose head may start now, if any. Called with the lock held.
+    std::deque<Job>* admissible() {
+        if (counters.in_flight >= limits.max_in_flight) return nullptr;
+        if (!interactive.empty()) {
+            return fits(interactive.front()) ? &interactive : nullptr;
+        }
+        size_t batch_slots = limits.max_in_flight > 1 ? limits.max_in_flight - 1 : 1;
+        if (!batch.empty() && batch_in_flight < batch_slots && fits(batch.front())) return &batch;
+        return nullptr;
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            std::deque<Job>* queue = nullptr;
+            changed.wait(lock, [&] { return stopping || (queue = admissible()) != nullptr; });
+            if (stopping) return;
+
+            bool is_batch = queue == &batch;
+            Job job = std::move(queue->front());
+            queue->pop_front();
+            ++counters.in_flight;
+            counters.peak_in_flight = std::max(counters.peak_in_flight, counters.in_flight);
+            counters.memory_in_use += job.memory_bytes;
+            if (is_batch) ++batch_in_flight;
+
+            lock.unlock();
+            try {
+                job.run();
+            } catch (...) {
+                // Jobs report their own errors; keep the accounting intact
+            }
+            lock.lock();
+
+            --counters.in_flight;
+            counters.memory_in_use -= job.memory_bytes;
+            if (is_batch) --batch_in_flight;
+            changed.notify_all();
+        }
+    }
+};
+
+} // namespace server
+} // namespace aqe
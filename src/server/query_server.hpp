@@ -0,0 +1,563 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../query/catalog.hpp"
+#include "../query/plan_cache.hpp"
+#include "../query/result_cache.hpp"
+#include "../query/result_writer.hpp"
+#include "admission_controller.hpp"
+
+namespace aqe {
+namespace server {
+
+// Framed protocol, all integers little-endian:
+//
+//   request:  u32 length, query text
+//   response: u8 status, u32 length, payload
+//
+// An OK response carries the result in the server's output format; an ERROR
+// response carries the error message. A connection may pipeline requests;
+// responses come back in request order.
+namespace protocol {
+
+enum Status : uint8_t { OK = 0, ERROR = 1 };
+
+constexpr size_t REQUEST_HEADER = 4;
+constexpr size_t RESPONSE_HEADER = 5;
+
+inline void appendU32(std::string& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+}
+
+inline uint32_t readU32(const char* data) {
+    uint32_t value = 0;
+    for (int i = 3; i >= 0; --i) value = (value << 8) | static_cast<uint8_t>(data[i]);
+    return value;
+}
+
+inline void appendRequest(std::string& out, std::string_view query) {
+    appendU32(out, static_cast<uint32_t>(query.size()));
+    out += query;
+}
+
+inline void appendResponse(std::string& out, Status status, std::string_view payload) {
+    out.push_back(static_cast<char>(status));
+    appendU32(out, static_cast<uint32_t>(payload.size()));
+    out += payload;
+}
+
+} // namespace protocol
+
+struct ServerOptions {
+    // Listen on this Unix socket path if set, otherwise on 127.0.0.1:tcp_port
+    // (0 picks a free port; see QueryServer::port()).
+    std::string unix_path;
+    uint16_t tcp_port = 0;
+    query::OutputFormat format = query::OutputFormat::JSON_LINES;
+    // Connections sending a larger request frame are closed.
+    size_t max_request_bytes = 1 << 20;
+    AdmissionLimits admission;
+    // Queries still running this long after they arrive (time spent waiting
+    // for admission included) fail with an error; zero means no limit.
+    std::chrono::milliseconds query_timeout{0};
+};
+
+// Serves queries against a loaded catalog to local clients. One epoll loop
+// accepts connections, reads requests and writes responses for all of them
+// with non-blocking sockets. Requests are parsed and planned on the loop
+// thread, which also answers result cache hits and errors directly; the rest
+// run concurrently on the admission controller's workers over the shared
+// catalog, and their responses are handed back to the loop. Each query is
+// planned and run against the catalog snapshot taken when it arrived, so
+// rows appended meanwhile do not change it partway. A client that disconnects
+// cancels its queries. stop() may be called from another thread or a signal
+// handler.
+class QueryServer {
+public:
+    QueryServer(const query::Catalog& source, ServerOptions server_options)
+        : catalog(source), options(std::move(server_options)), writer(options.format) {
+        wake_fd = checked(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd");
+        done_fd = checked(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), "eventfd");
+        admission = std::make_unique<AdmissionController>(options.admission);
+    }
+
+    ~QueryServer() {
+        admission.reset(); // workers touch everything below
+        for (const auto& entry : connections) ::close(entry.first);
+        if (listen_fd >= 0) {
+            ::close(listen_fd);
+            if (!options.unix_path.empty()) ::unlink(options.unix_path.c_str());
+        }
+        if (epoll_fd >= 0) ::close(epoll_fd);
+        ::close(wake_fd);
+        ::close(done_fd);
+    }
+
+    QueryServer(const QueryServer&) = delete;
+    QueryServer& operator=(const QueryServer&) = delete;
+
+    // Binds and listens. Throws std::runtime_error if the socket cannot be
+    // set up. A stale Unix socket file at the path is replaced.
+    void listen() {
+        if (options.unix_path.empty()) {
+            listen_fd = checked(::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), "socket");
+            int one = 1;
+            ::setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            sockaddr_in addr{};
+            addr.sin_family = AF_INET;
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            addr.sin_port = htons(options.tcp_port);
+            checked(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), "bind");
+            socklen_t length = sizeof(addr);
+            checked(::getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &length), "getsockname");
+            bound_port = ntohs(addr.sin_port);
+        } else {
+            sockaddr_un addr{};
+            if (options.unix_path.size() >= sizeof(addr.sun_path)) {
+                throw std::runtime_error("Socket path too long: " + options.unix_path);
+            }
+            listen_fd = checked(::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0), "socket");
+            addr.sun_family = AF_UNIX;
+            std::memcpy(addr.sun_path, options.unix_path.c_str(), options.unix_path.size() + 1);
+            ::unlink(options.unix_path.c_str());
+            checked(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), "bind");
+        }
+        checked(::listen(listen_fd, SOMAXCONN), "listen");
+
+        epoll_fd = checked(::epoll_create1(EPOLL_CLOEXEC), "epoll_create1");
+        watch(listen_fd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(wake_fd, EPOLLIN, EPOLL_CTL_ADD);
+        watch(done_fd, EPOLLIN, EPOLL_CTL_ADD);
+    }
+
+    // Runs the event loop until stop() is called.
+    void run() {
+        if (epoll_fd < 0) listen();
+        std::vector<epoll_event> events(64);
+        while (true) {
+            int ready = ::epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), -1);
+            if (ready < 0) {
+                if (errno == EINTR) continue;
+                throw std::runtime_error(std::string("epoll_wait: ") + std::strerror(errno));
+            }
+            for (int i = 0; i < ready; ++i) {
+                int fd = events[i].data.fd;
+                if (fd == wake_fd) return;
+                if (fd == listen_fd) {
+                    acceptClients();
+                } else if (fd == done_fd) {
+                    deliverCompleted();
+                } else {
+                    serviceClient(fd, events[i].events);
+                }
+            }
+        }
+    }
+
+    // Async-signal-safe.
+    void stop() { signal(wake_fd); }
+
+    uint16_t port() const { return bound_port; }
+    size_t connectionCount() const { return connections.size(); }
+    AdmissionController::Stats admissionStats() const { return admission->stats(); }
+
+private:
+    struct Connection {
+        uint64_t id = 0;
+        std::string input;
+        std::string output;
+        size_t output_offset = 0;
+        uint64_t next_request = 0;  // sequence number of the next request read
+        uint64_t next_response = 0; // sequence number of the next response owed
+        std::map<uint64_t, std::string> finished; // responses that overtook earlier ones
+        std::unordered_map<uint64_t, std::shared_ptr<query::CancellationToken>> running; // by sequence
+        bool closing = false;  // peer finished sending
+        bool writing = false;  // waiting for EPOLLOUT
+    };
+
+    // A response produced on a worker thread.
+    struct Completion {
+        uint64_t connection;
+        uint64_t sequence;
+        std::string frame;
+    };
+
+    const query::Catalog& catalog;
+    ServerOptions options;
+    query::ResultWriter writer;
+    query::PlanCache plan_cache; // loop thread only
+    std::mutex result_cache_mutex;
+    query::ResultCache result_cache;
+
+    int listen_fd = -1;
+    int epoll_fd = -1;
+    int wake_fd = -1;
+    int done_fd = -1;
+    uint16_t bound_port = 0;
+    uint64_t next_connection_id = 0;
+    std::unordered_map<int, Connection> connections;
+    std::unordered_map<uint64_t, int> connection_fds;
+
+    std::mutex completed_mutex;
+    std::vector<Completion> completed;
+
+    std::unique_ptr<AdmissionController> admission;
+
+    static int checked(int rc, const char* what) {
+        if (rc < 0) throw std::runtime_error(std::string(what) + ": " + std::strerror(errno));
+        return rc;
+    }
+
+    static void signal(int event_fd) {
+        uint64_t one = 1;
+        [[maybe_unused]] ssize_t written = ::write(event_fd, &one, sizeof(one));
+    }
+
+    void watch(int fd, uint32_t events, int op) {
+        epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        checked(::epoll_ctl(epoll_fd, op, fd, &event), "epoll_ctl");
+    }
+
+    void acceptClients() {
+        while (true) {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                return; // EAGAIN, or out of descriptors until a client leaves
+            }
+            if (options.unix_path.empty()) {
+                int one = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+            Connection conn;
+            conn.id = next_connection_id++;
+            connection_fds[conn.id] = fd;
+            connections.emplace(fd, std::move(conn));
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_ADD);
+        }
+    }
+
+    // Queries still running for a closed connection are cancelled.
+    void closeClient(int fd) {
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        auto it = connections.find(fd);
+        for (const auto& entry : it->second.running) entry.second->cancel();
+        connection_fds.erase(it->second.id);
+        connections.erase(it);
+    }
+
+    void serviceClient(int fd, uint32_t events) {
+        auto it = connections.find(fd);
+        if (it == connections.end()) return;
+        Connection& conn = it->second;
+        if (events & (EPOLLHUP | EPOLLERR)) {
+            closeClient(fd); // the peer can no longer read responses
+            return;
+        }
+
+        if (events & (EPOLLIN | EPOLLRDHUP)) {
+            char buffer[64 * 1024];
+            while (true) {
+                ssize_t n = ::read(fd, buffer, sizeof(buffer));
+                if (n > 0) {
+                    conn.input.append(buffer, static_cast<size_t>(n));
+                } else if (n == 0) {
+                    conn.closing = true;
+                    break;
+                } else if (errno == EINTR) {
+                    continue;
+                } else if (errno == EAGAIN) {
+                    break;
+                } else {
+                    closeClient(fd);
+                    return;
+                }
+            }
+            if (!handleRequests(conn)) {
+                closeClient(fd);
+                return;
+            }
+        }
+        flushClient(fd, conn);
+    }
+
+    // Dispatches every complete request frame in the input buffer. Returns
+    // false if the client sent an oversized frame.
+    bool handleRequests(Connection& conn) {
+        size_t offset = 0;
+        while (conn.input.size() - offset >= protocol::REQUEST_HEADER) {
+            size_t length = protocol::readU32(conn.input.data() + offset);
+            if (length > options.max_request_bytes) return false;
+            if (conn.input.size() - offset - protocol::REQUEST_HEADER < length) break;
+            std::string text = conn.input.substr(offset + protocol::REQUEST_HEADER, length);
+            offset += protocol::REQUEST_HEADER + length;
+            dispatch(conn, conn.next_request++, text);
+        }
+        conn.input.erase(0, offset);
+        return true;
+    }
+
+    // Plans a request and either answers it at once (errors, cached results)
+    // or queues it for a worker.
+    void dispatch(Connection& conn, uint64_t sequence, const std::string& text) {
+        std::shared_ptr<const query::Query> parsed;
+        try {
+            parsed = plan_cache.get(text);
+            auto snapshot = std::make_shared<query::Catalog::Snapshot>(catalog.snapshot());
+            uint64_t version = (*snapshot)->version();
+            std::shared_ptr<const query::QueryResult> cached;
+            {
+                std::lock_guard<std::mutex> lock(result_cache_mutex);
+                cached = result_cache.lookup(*parsed, version);
+            }
+            if (cached) {
+                deliver(conn, sequence, respond(*cached));
+                return;
+            }
+
+            query::PhysicalPlan plan = (*snapshot)->plan(parsed);
+            auto token = options.query_timeout.count() > 0
+                             ? query::CancellationToken::withTimeout(options.query_timeout)
+                             : std::make_shared<query::CancellationToken>();
+            plan.cancellation = token;
+            QueryPriority priority = priorityOf(plan);
+            size_t memory = estimateMemory(plan, **snapshot);
+            uint64_t connection = conn.id;
+            conn.running.emplace(sequence, std::move(token));
+            admission->submit(priority, memory, [this, plan = std::move(plan), snapshot, version, connection,
+                                                 sequence] {
+                std::string frame;
+                try {
+                    plan.checkCancelled(); // timed out or abandoned while queued
+                    std::shared_ptr<const query::QueryResult> result = query::executeQuery(plan, **snapshot);
+                    {
+                        std::lock_guard<std::mutex> lock(result_cache_mutex);
+                        result_cache.store(*plan.query, version, result);
+                    }
+                    frame = respond(*result);
+                } catch (const std::exception& e) {
+                    protocol::appendResponse(frame, protocol::ERROR, e.what());
+                }
+                {
+                    std::lock_guard<std::mutex> lock(completed_mutex);
+                    completed.push_back(Completion{connection, sequence, std::move(frame)});
+                }
+                signal(done_fd);
+            });
+        } catch (const std::exception& e) {
+            std::string frame;
+            protocol::appendResponse(frame, protocol::ERROR, e.what());
+            deliver(conn, sequence, std::move(frame));
+        }
+    }
+
+    std::string respond(const query::QueryResult& result) const {
+        std::string payload;
+        writer.append(result, payload);
+        std::string frame;
+        protocol::appendResponse(frame, protocol::OK, payload);
+        return frame;
+    }
+
+    // Queues a response, releasing it and any that were waiting on it in
+    // request order.
+    static void deliver(Connection& conn, uint64_t sequence, std::string frame) {
+        if (sequence != conn.next_response) {
+            conn.finished.emplace(sequence, std::move(frame));
+            return;
+        }
+        conn.output += frame;
+        ++conn.next_response;
+        for (auto it = conn.finished.begin(); it != conn.finished.end() && it->first == conn.next_response;
+             it = conn.finished.erase(it)) {
+            conn.output += it->second;
+            ++conn.next_response;
+        }
+    }
+
+    void deliverCompleted() {
+        uint64_t count;
+        [[maybe_unused]] ssize_t n = ::read(done_fd, &count, sizeof(count));
+        std::vector<Completion> batch;
+        {
+            std::lock_guard<std::mutex> lock(completed_mutex);
+            batch.swap(completed);
+        }
+        std::vector<int> touched;
+        for (auto& completion : batch) {
+            auto fd = connection_fds.find(completion.connection);
+            if (fd == connection_fds.end()) continue;
+            Connection& conn = connections.at(fd->second);
+            conn.running.erase(completion.sequence);
+            deliver(conn, completion.sequence, std::move(completion.frame));
+            touched.push_back(fd->second);
+        }
+        std::sort(touched.begin(), touched.end());
+        touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+        for (int fd : touched) flushClient(fd, connections.at(fd));
+    }
+
+    // Writes as much pending output as the socket takes, watching for
+    // writability only while output is left over. A connection whose peer
+    // has finished sending is closed once every response is written.
+    void flushClient(int fd, Connection& conn) {
+        while (conn.output_offset < conn.output.size()) {
+            ssize_t n = ::send(fd, conn.output.data() + conn.output_offset,
+                               conn.output.size() - conn.output_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                conn.output_offset += static_cast<size_t>(n);
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n < 0 && errno == EAGAIN) {
+                if (!conn.writing) {
+                    watch(fd, conn.closing ? EPOLLOUT : EPOLLIN | EPOLLOUT | EPOLLRDHUP, EPOLL_CTL_MOD);
+                    conn.writing = true;
+                }
+                return;
+            } else {
+                closeClient(fd);
+                return;
+            }
+        }
+        conn.output.clear();
+        conn.output_offset = 0;
+        if (conn.closing) {
+            if (conn.next_response == conn.next_request) {
+                closeClient(fd);
+            } else {
+                // Stop polling a half-closed socket while responses are computed
+                watch(fd, 0, EPOLL_CTL_MOD);
+                conn.writing = false;
+            }
+        } else if (conn.writing) {
+            watch(fd, EPOLLIN | EPOLLRDHUP, EPOLL_CTL_MOD);
+            conn.writing = false;
+        }
+    }
+};
+
+// Blocking client for the framed protocol.
+class QueryClient {
+public:
+    struct Response {
+        protocol::Status status;
+        std::string payload;
+    };
+
+    // Connects to a Unix socket path. Throws std::runtime_error.
+    static QueryClient connectUnix(const std::string& path) {
+        sockaddr_un addr{};
+        if (path.size() >= sizeof(addr.sun_path)) throw std::runtime_error("Socket path too long: " + path);
+        QueryClient client(::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        client.connect(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        return client;
+    }
+
+    // Connects to 127.0.0.1:port. Throws std::runtime_error.
+    static QueryClient connectTcp(uint16_t port) {
+        QueryClient client(::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        client.connect(reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+        return client;
+    }
+
+    QueryClient(QueryClient&& other) noexcept : fd(other.fd) { other.fd = -1; }
+    QueryClient& operator=(QueryClient&& other) noexcept {
+        std::swap(fd, other.fd);
+        return *this;
+    }
+    ~QueryClient() {
+        if (fd >= 0) ::close(fd);
+    }
+
+    void send(std::string_view query) {
+        std::string frame;
+        protocol::appendRequest(frame, query);
+        writeAll(frame);
+    }
+
+    Response receive() {
+        char header[protocol::RESPONSE_HEADER];
+        readAll(header, sizeof(header));
+        Response response{static_cast<protocol::Status>(header[0]), std::string()};
+        response.payload.resize(protocol::readU32(header + 1));
+        readAll(response.payload.data(), response.payload.size());
+        return response;
+    }
+
+    Response query(std::string_view text) {
+        send(text);
+        return receive();
+    }
+
+    // Sends raw bytes, for clients that frame requests themselves.
+    void writeAll(std::string_view bytes) {
+        while (!bytes.empty()) {
+            ssize_t n = ::send(fd, bytes.data(), bytes.size(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error(std::string("send: ") + std::strerror(errno));
+            bytes.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+
+private:
+    int fd;
+
+    explicit QueryClient(int socket_fd) : fd(socket_fd) {
+        if (fd < 0) throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    }
+
+    void connect(const sockaddr* addr, socklen_t length) {
+        if (::connect(fd, addr, length) < 0) {
+            throw std::runtime_error(std::string("connect: ") + std::strerror(errno));
+        }
+    }
+
+    void readAll(char* data, size_t length) {
+        while (length > 0) {
+            ssize_t n = ::recv(fd, data, length, 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) throw std::runtime_error(std::string("recv: ") + std::strerror(errno));
+            if (n == 0) throw std::runtime_error("Connection closed by server");
+            data += n;
+            length -= static_cast<size_t>(n);
+        }
+    }
+};
+
+} // namespace server
+} // namespace aqe
+
+#endif // __linux__
@@ -4,6 +4,7 @@
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <charconv>
 
 namespace aqe {
 namespace utils {
@@ -41,5 +42,23 @@ static std::vector<std::string> splitCSV(const std::string& line) {
     return result;
 }
 
+// Appends `value` in fixed notation with `precision` decimals, the format
+// std::to_string uses, without going through printf or the locale.
+static void appendFixed(std::string& out, double value, int precision = 6) {
+    char buffer[400]; // fits any finite double in fixed notation
+    auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision);
+    if (ec == std::errc()) {
+        out.append(buffer, end);
+    } else {
+        out += std::to_string(value);
+    }
+}
+
+static std::string formatFixed(double value, int precision = 6) {
+    std::string out;
+    appendFixed(out, value, precision);
+    return out;
+}
+
 } // namespace utils
 } // namespace aqe
\ No newline at end of file
@@ -1,5 +1,10 @@
 #include <gtest/gtest.h>
 #include "core/sampling.hpp"
+#include "core/sketching.hpp"
+#include "core/epoch.hpp"
+#include "core/ring_buffer.hpp"
+#include <thread>
+#include <string>
 
 // Test fixture for sampling tests
 class SamplingTest : public ::testing::Test {
@@ -30,4 +35,84 @@ TEST_F(SamplingTest, SimpleRandomSampleIsApproximate) {
     // Should be roughly 10% of 1000, we'll test for a reasonable range
     ASSERT_GT(sample.size(), 50);
     ASSERT_LT(sample.size(), 150);
-}
\ No newline at end of file
+}
+TEST(SketchTest, BloomFilterHasNoFalseNegativesAndFewFalsePositives) {
+    aqe::core::BloomFilter filter(10000);
+    for (int i = 0; i < 1000; ++i) filter.add("key" + std::to_string(i));
+    for (int i = 0; i < 1000; ++i) EXPECT_TRUE(filter.mightContain("key" + std::to_string(i)));
+
+    int false_positives = 0;
+    for (int i = 1000; i < 11000; ++i) false_positives += filter.mightContain("key" + std::to_string(i));
+    EXPECT_LT(false_positives, 500); // ~1.7% expected with 10 bits per key
+}
+
+TEST(EpochTest, RetiredObjectsOutliveReadersPinnedBeforeThem) {
+    aqe::core::EpochManager epochs;
+    auto early = std::make_shared<int>(1);
+    std::weak_ptr<int> watch = early;
+
+    {
+        auto reader = epochs.pin();
+        epochs.retire(std::move(early));
+        EXPECT_EQ(epochs.reclaim(), 0);
+        EXPECT_FALSE(watch.expired());
+
+        auto later = epochs.pin(); // pinned after the retire; does not hold it back
+        auto moved = std::move(reader);
+        EXPECT_EQ(epochs.reclaim(), 0);
+    }
+    EXPECT_EQ(epochs.reclaim(), 1);
+    EXPECT_TRUE(watch.expired());
+
+    auto reader = epochs.pin();
+    epochs.retire(std::make_shared<int>(2));
+    EXPECT_EQ(epochs.retiredCount(), 1);
+}
+
+TEST(RingBufferTest, HoldsCapacityItemsInOrder) {
+    aqe::core::MpscRingBuffer<int> ring(3);
+    EXPECT_EQ(ring.capacity(), 4);
+    for (int i = 0; i < 4; ++i) {
+        int value = i;
+        EXPECT_TRUE(ring.tryPush(value));
+    }
+    int extra = 9;
+    EXPECT_FALSE(ring.tryPush(extra));
+    EXPECT_EQ(extra, 9);
+
+    int out = -1;
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(ring.tryPop(out));
+        EXPECT_EQ(out, i);
+    }
+    EXPECT_FALSE(ring.tryPop(out));
+    EXPECT_THROW(aqe::core::MpscRingBuffer<int>(0), std::invalid_argument);
+}
+
+TEST(RingBufferTest, ManyProducersOneConsumerLoseNothing) {
+    constexpr int PRODUCERS = 4;
+    constexpr int PER_PRODUCER = 20000;
+    aqe::core::MpscRingBuffer<std::pair<int, int>> ring(64);
+    std::vector<std::thread> producers;
+    for (int p = 0; p < PRODUCERS; ++p) {
+        producers.emplace_back([&ring, p] {
+            for (int i = 0; i < PER_PRODUCER; ++i) ring.push({p, i});
+        });
+    }
+
+    std::vector<int> next(PRODUCERS, 0);
+    std::pair<int, int> item;
+    unsigned idle = 0;
+    for (int received = 0; received < PRODUCERS * PER_PRODUCER;) {
+        if (!ring.tryPop(item)) {
+            ring.backoff(idle++);
+            continue;
+        }
+        idle = 0;
+        EXPECT_EQ(item.second, next[item.first]); // each producer's items stay in order
+        next[item.first] = item.second + 1;
+        ++received;
+    }
+    for (auto& producer : producers) producer.join();
+    EXPECT_FALSE(ring.tryPop(item));
+}
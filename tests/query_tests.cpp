@@ -1,8 +1,22 @@
 #include <gtest/gtest.h>
 #include "query/parser.hpp"
 #include "query/executor.hpp"
+#include "query/plan_cache.hpp"
+#include "query/prepared_statement.hpp"
+#include "query/planner.hpp"
+#include "query/result_cache.hpp"
+#include "query/cube.hpp"
+#include "query/shared_scan.hpp"
+#include "query/join.hpp"
+#include "query/catalog.hpp"
+#include "query/result_export.hpp"
+#include "query/result_writer.hpp"
+#include "query/stream_ingest.hpp"
+#include "query/compactor.hpp"
 #include <vector>
 #include <algorithm>
+#include <sstream>
+#include <thread>
 
 using namespace aqe::query;
 
@@ -65,6 +79,102 @@ TEST_F(QueryTest, ParserThrowsOnMissingFromClause) {
     EXPECT_THROW(parser.parse("SELECT value"), ParseError);
 }
 
+TEST_F(QueryTest, ParserDoesNotMatchKeywordsInsideIdentifiers) {
+    QueryParser parser;
+    auto query = parser.parse("select sampled_from, count(*) from fromage group by sampled_from");
+    EXPECT_EQ(query->table_name, "fromage");
+    ASSERT_EQ(query->group_by_columns.size(), 1);
+    EXPECT_EQ(query->group_by_columns[0], "sampled_from");
+    EXPECT_EQ(query->columns[1].alias, "COUNT(*)");
+    EXPECT_EQ(query->sampling.method, SamplingMethod::NONE);
+}
+
+TEST_F(QueryTest, ParserHandlesReservoirAndStratifiedSampling) {
+    QueryParser parser;
+    auto reservoir = parser.parse("SELECT AVG(value) FROM data SAMPLE RESERVOIR 500");
+    EXPECT_EQ(reservoir->sampling.method, SamplingMethod::RESERVOIR);
+    EXPECT_EQ(reservoir->sampling.size, 500);
+
+    auto stratified = parser.parse("SELECT AVG(value) FROM data SAMPLE STRATIFIED BY category 20%");
+    EXPECT_EQ(stratified->sampling.method, SamplingMethod::STRATIFIED);
+    EXPECT_EQ(stratified->sampling.stratification_column, "category");
+    EXPECT_DOUBLE_EQ(stratified->sampling.rate, 0.2);
+}
+
+TEST_F(QueryTest, ParserRejectsFractionalOrNegativeCounts) {
+    QueryParser parser;
+    EXPECT_EQ(parser.parse("SELECT value FROM data LIMIT 3")->limit, 3);
+    EXPECT_THROW(parser.parse("SELECT value FROM data LIMIT 2.5"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT value FROM data LIMIT -1"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT value FROM data LIMIT 1e30"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT AVG(value) FROM data SAMPLE RESERVOIR 10.5"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT AVG(value) FROM data SAMPLE SYSTEMATIC 0.5"), ParseError);
+}
+
+TEST_F(QueryTest, ParserReportsErrorPosition) {
+    QueryParser parser;
+    try {
+        parser.parse("SELECT SUM(value FROM data");
+        FAIL() << "Expected ParseError";
+    } catch (const ParseError& e) {
+        EXPECT_EQ(e.position(), 17);
+    }
+}
+
+TEST_F(QueryTest, ParserRecordsPlaceholders) {
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*) FROM data SAMPLE ?%");
+    ASSERT_EQ(query->parameters.size(), 1);
+    EXPECT_TRUE(query->hasUnboundParameters());
+    query->bindParameter(0, 25.0);
+    EXPECT_DOUBLE_EQ(query->sampling.rate, 0.25);
+    EXPECT_THROW(query->bindParameter(0, 250.0), ParseError);
+}
+
+// --- Plan Cache Tests ---
+TEST_F(QueryTest, PlanCacheNormalizesCaseWhitespaceAndLiterals) {
+    EXPECT_EQ(normalizeQuery("select  sum(value) from data sample 10%").key,
+              normalizeQuery("SELECT SUM(value)\nFROM data SAMPLE 25 %").key);
+    EXPECT_NE(normalizeQuery("SELECT SUM(value) FROM data").key,
+              normalizeQuery("SELECT SUM(price) FROM data").key);
+}
+
+TEST_F(QueryTest, PlanCacheReusesTemplateAndBindsLiterals) {
+    PlanCache cache;
+    auto first = cache.get("SELECT COUNT(*) FROM data SAMPLE 10%");
+    auto second = cache.get("select count(*) from data sample 30%");
+    EXPECT_EQ(cache.misses(), 1);
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_DOUBLE_EQ(first->sampling.rate, 0.1);
+    EXPECT_DOUBLE_EQ(second->sampling.rate, 0.3);
+    EXPECT_THROW(cache.get("SELECT COUNT(*) FROM data SAMPLE 300%"), ParseError);
+}
+
+TEST_F(QueryTest, PlanCacheKeepsOrderByOrdinals) {
+    PlanCache cache;
+    auto by_sum = cache.get("SELECT category, SUM(value) FROM data GROUP BY category ORDER BY 2 DESC LIMIT 3");
+    auto by_name = cache.get("SELECT category, SUM(value) FROM data GROUP BY category ORDER BY 1 LIMIT 5");
+    EXPECT_EQ(cache.misses(), 2);
+    EXPECT_EQ(by_sum->order_by[0].column_index, 1);
+    EXPECT_TRUE(by_sum->order_by[0].descending);
+    EXPECT_EQ(by_sum->limit, 3);
+    EXPECT_EQ(by_name->order_by[0].column_index, 0);
+    EXPECT_EQ(by_name->limit, 5);
+}
+
+TEST_F(QueryTest, PlanCacheEvictsLeastRecentlyUsed) {
+    PlanCache cache(2);
+    cache.get("SELECT COUNT(*) FROM a");
+    cache.get("SELECT COUNT(*) FROM b");
+    cache.get("SELECT COUNT(*) FROM a");
+    cache.get("SELECT COUNT(*) FROM c"); // evicts b
+    EXPECT_EQ(cache.size(), 2);
+    cache.get("SELECT COUNT(*) FROM a");
+    EXPECT_EQ(cache.hits(), 2);
+    cache.get("SELECT COUNT(*) FROM b");
+    EXPECT_EQ(cache.misses(), 4);
+}
+
 // --- Executor Tests ---
 TEST_F(QueryTest, ExecutorHandlesExactCount) {
     QueryParser parser;
@@ -124,4 +234,969 @@ TEST_F(QueryTest, ExecutorHandlesMinAndMax) {
     ASSERT_EQ(result->getRows()[0].size(), 2);
     EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][0]), 100.0); // Min
     EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][1]), 300.0); // Max
-}
\ No newline at end of file
+}
+
+TEST_F(QueryTest, ExecutorAppliesWhereClause) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM data WHERE category = 'A' OR value >= 300");
+    auto result = executor.execute(*query, sample_data);
+    ASSERT_EQ(result->getRows().size(), 1);
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][0]), 3.0);
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][1]), 550.0);
+}
+
+TEST_F(QueryTest, ExecutorCountsZeroWhenWhereMatchesNothing) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT COUNT(*) FROM data WHERE value < -1");
+    auto result = executor.execute(*query, sample_data);
+    ASSERT_EQ(result->getRows().size(), 1);
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][0]), 0.0);
+}
+
+// --- Prepared Statement Tests ---
+TEST_F(QueryTest, PreparedStatementExecutesWithBoundValues) {
+    PreparedStatement stmt("SELECT SUM(value) FROM data WHERE category = ? AND value > ?");
+    ASSERT_EQ(stmt.parameterCount(), 2);
+    EXPECT_THROW(stmt.execute(sample_data), std::invalid_argument);
+
+    stmt.bind(0, "B").bind(1, 200.0);
+    EXPECT_DOUBLE_EQ(std::stod(stmt.execute(sample_data)->getRows()[0][0]), 250.0);
+
+    stmt.bind(0, "A").bind(1, 0.0);
+    EXPECT_DOUBLE_EQ(std::stod(stmt.execute(sample_data)->getRows()[0][0]), 250.0);
+    EXPECT_THROW(stmt.bind(2, 1.0), std::out_of_range);
+}
+
+TEST_F(QueryTest, PreparedStatementValidatesSamplingParameters) {
+    PreparedStatement stmt("SELECT COUNT(*) FROM data SAMPLE ?%");
+    stmt.bind(0, 150.0);
+    EXPECT_THROW(stmt.execute(sample_data), ParseError);
+    stmt.bind(0, "ten");
+    EXPECT_THROW(stmt.execute(sample_data), ParseError);
+    stmt.bind(0, 100.0);
+    EXPECT_TRUE(stmt.execute(sample_data)->isApproximate());
+}
+
+// --- Planner Tests ---
+TEST_F(QueryTest, PlannerPushesRandomSampleBelowFilter) {
+    QueryParser parser;
+    Planner planner;
+    auto random = parser.parse("SELECT COUNT(*) FROM data WHERE value > 100 SAMPLE 50%");
+    EXPECT_TRUE(planner.plan(*random).sample_before_filter);
+    auto reservoir = parser.parse("SELECT COUNT(*) FROM data WHERE value > 100 SAMPLE RESERVOIR 2");
+    EXPECT_FALSE(planner.plan(*reservoir).sample_before_filter);
+}
+
+TEST_F(QueryTest, PlannerKeepsSystematicSampleAboveFilter) {
+    // Every other row matches, so every 2nd table row is all or none of them
+    std::vector<DataRow> rows;
+    for (int i = 0; i < 100; ++i) rows.push_back({{{"value", std::to_string(i % 2)}}});
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT COUNT(*) FROM data WHERE value = 1 SAMPLE SYSTEMATIC 2");
+    PhysicalPlan plan = Planner().plan(*query);
+    EXPECT_FALSE(plan.sample_before_filter);
+    EXPECT_DOUBLE_EQ(std::stod(executor.execute(plan, rows)->getRows()[0][0]), 50.0);
+
+    PhysicalPlan pushed = plan;
+    pushed.sample_before_filter = true;
+    EXPECT_NE(std::stod(executor.execute(pushed, rows)->getRows()[0][0]), 50.0);
+}
+
+TEST_F(QueryTest, ParseNumberAcceptsWhitespaceAndNumericPrefixes) {
+    double value = 0.0;
+    EXPECT_TRUE(parseNumber(" 12", value));
+    EXPECT_DOUBLE_EQ(value, 12.0);
+    EXPECT_TRUE(parseNumber("12ms", value));
+    EXPECT_DOUBLE_EQ(value, 12.0);
+    EXPECT_TRUE(parseNumber("+1.5e2", value));
+    EXPECT_DOUBLE_EQ(value, 150.0);
+    EXPECT_FALSE(parseNumber("", value));
+    EXPECT_FALSE(parseNumber("  ", value));
+    EXPECT_FALSE(parseNumber("ms12", value));
+    EXPECT_FALSE(parseNumber("+-1", value));
+    EXPECT_FALSE(parseNumber("1e999", value));
+}
+
+TEST_F(QueryTest, PlannerChoosesGroupingFromStatistics) {
+    QueryParser parser;
+    auto stats = TableStatistics::compute(sample_data);
+    auto query = parser.parse("SELECT category, SUM(value), AVG(value), MAX(value) FROM data GROUP BY category");
+
+    auto with_stats = Planner(&stats).plan(*query);
+    EXPECT_EQ(with_stats.grouping, GroupingStrategy::DIRECT_INDEXED);
+    EXPECT_EQ(with_stats.input_columns.size(), 1); // SUM/AVG/MAX fused over one input
+    EXPECT_EQ(Planner().plan(*query).grouping, GroupingStrategy::HASH);
+
+    QueryExecutor executor;
+    auto result = executor.execute(with_stats, sample_data);
+    EXPECT_EQ(result->getRows().size(), 3);
+}
+
+TEST_F(QueryTest, PlannerAnswersCountsFromStatisticsAndSketches) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto stats = TableStatistics::compute(sample_data);
+    Planner planner(&stats);
+
+    auto exact = parser.parse("SELECT COUNT(*) FROM data");
+    auto exact_plan = planner.plan(*exact);
+    EXPECT_EQ(exact_plan.access, AccessPath::STATISTICS_LOOKUP);
+    EXPECT_DOUBLE_EQ(std::stod(executor.execute(exact_plan, sample_data)->getRows()[0][0]), 5.0);
+
+    auto approx = parser.parse("SELECT COUNT(*) FROM data WHERE category = 'A' SAMPLE 10%");
+    auto approx_plan = planner.plan(*approx);
+    EXPECT_EQ(approx_plan.access, AccessPath::SKETCH_LOOKUP);
+    auto result = executor.execute(approx_plan, sample_data);
+    EXPECT_TRUE(result->isApproximate());
+    EXPECT_GE(std::stod(result->getRows()[0][0]), 2.0);
+}
+
+// --- Result Cache Tests ---
+TEST_F(QueryTest, ResultCacheReusesExactOrLargerSampleAnswers) {
+    QueryParser parser;
+    ResultCache cache;
+    auto exact = parser.parse("SELECT SUM(value) FROM data");
+    auto sampled = parser.parse("SELECT SUM(value) FROM data SAMPLE 10%");
+
+    auto sampled_result = std::make_shared<QueryResult>();
+    sampled_result->setApproximate(true);
+    cache.store(*sampled, 1, sampled_result);
+    EXPECT_EQ(cache.lookup(*exact, 1), nullptr);
+    EXPECT_EQ(cache.lookup(*parser.parse("SELECT SUM(value) FROM data SAMPLE 5%"), 1), sampled_result);
+    EXPECT_EQ(cache.lookup(*parser.parse("SELECT SUM(value) FROM data SAMPLE 50%"), 1), nullptr);
+
+    auto exact_result = std::make_shared<QueryResult>();
+    cache.store(*exact, 1, exact_result);
+    EXPECT_EQ(cache.size(), 1); // the exact answer supersedes the sample
+    EXPECT_EQ(cache.lookup(*parser.parse("SELECT SUM(value) FROM data SAMPLE 50%"), 1), exact_result);
+    EXPECT_EQ(cache.lookup(*parser.parse("SELECT SUM(value) FROM data WHERE value > 1"), 1), nullptr);
+}
+
+TEST_F(QueryTest, ResultCacheKeysLiteralsExactly) {
+    QueryParser parser;
+    EXPECT_NE(resultCacheKey(*parser.parse("SELECT COUNT(*) FROM data WHERE value > 99.9999999")),
+              resultCacheKey(*parser.parse("SELECT COUNT(*) FROM data WHERE value > 100.0000001")));
+    EXPECT_EQ(resultCacheKey(*parser.parse("SELECT COUNT(*) FROM data WHERE value > 100")),
+              resultCacheKey(*parser.parse("SELECT COUNT(*) FROM data WHERE value > 100.0")));
+}
+
+TEST_F(QueryTest, ResultCacheMissesAfterDataVersionChange) {
+    QueryParser parser;
+    ResultCache cache;
+    auto query = parser.parse("SELECT COUNT(*) FROM data");
+    cache.store(*query, 1, std::make_shared<QueryResult>());
+    EXPECT_NE(cache.lookup(*query, 1), nullptr);
+    EXPECT_EQ(cache.lookup(*query, 2), nullptr);
+    EXPECT_EQ(cache.size(), 0);
+}
+
+// --- Cube Tests ---
+TEST_F(QueryTest, PlannerRewritesCoveredQueriesToCube) {
+    QueryParser parser;
+    CubeRegistry cubes;
+    cubes.declare({"by_category", "data", {"category"}, {"value"}}, sample_data);
+    Planner planner(nullptr, &cubes);
+
+    auto covered = parser.parse("SELECT category, COUNT(*), AVG(value) FROM data WHERE category != 'C' GROUP BY category");
+    auto plan = planner.plan(*covered);
+    ASSERT_EQ(plan.access, AccessPath::CUBE_LOOKUP);
+
+    QueryExecutor executor;
+    auto result_rows = executor.execute(plan, {})->getRows();
+    ASSERT_EQ(result_rows.size(), 2);
+    std::sort(result_rows.begin(), result_rows.end());
+    EXPECT_EQ(result_rows[0][0], "A");
+    EXPECT_DOUBLE_EQ(std::stod(result_rows[0][1]), 2.0);
+    EXPECT_DOUBLE_EQ(std::stod(result_rows[0][2]), 125.0);
+
+    auto filtered_on_measure = parser.parse("SELECT SUM(value) FROM data WHERE value > 100");
+    EXPECT_EQ(planner.plan(*filtered_on_measure).access, AccessPath::TABLE_SCAN);
+    auto other_table = parser.parse("SELECT SUM(value) FROM other");
+    EXPECT_EQ(planner.plan(*other_table).access, AccessPath::TABLE_SCAN);
+}
+
+TEST_F(QueryTest, CubeIsMaintainedOnAppend) {
+    QueryParser parser;
+    CubeRegistry cubes;
+    cubes.declare({"by_category", "data", {"category"}, {"value"}}, sample_data);
+    std::vector<DataRow> batch = {
+        {{{"category", "D"}, {"value", "50"}}},
+        {{{"category", "A"}, {"value", "10"}}}
+    };
+    CubeRegistry appended = cubes.withRows("data", batch.begin(), batch.end());
+
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value), MIN(value) FROM data");
+    auto result = executor.execute(Planner(nullptr, &appended).plan(*query), {});
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][0]), 7.0);
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][1]), 1060.0);
+    EXPECT_DOUBLE_EQ(std::stod(result->getRows()[0][2]), 10.0);
+
+    // The original registry still answers from the rows it was built on
+    auto before = executor.execute(Planner(nullptr, &cubes).plan(*query), {});
+    EXPECT_DOUBLE_EQ(std::stod(before->getRows()[0][0]), 5.0);
+}
+
+TEST_F(QueryTest, CubeMatchesScanWhenDimensionsAreMissing) {
+    std::vector<DataRow> rows = sample_data;
+    rows.push_back({{{"value", "40"}}});                            // no category
+    rows.push_back({{{"category", "NULL"}, {"value", "60"}}});      // the text "NULL"
+    CubeRegistry cubes;
+    cubes.declare({"by_category", "data", {"category"}, {"value"}}, rows);
+
+    QueryParser parser;
+    QueryExecutor executor;
+    for (const char* text : {"SELECT COUNT(*), SUM(value) FROM data WHERE category != 'A'",
+                             "SELECT COUNT(*), SUM(value) FROM data WHERE category = 'NULL'",
+                             "SELECT COUNT(*), SUM(value) FROM data WHERE category >= 'A' OR category < 'A'",
+                             "SELECT category, COUNT(*) FROM data GROUP BY category ORDER BY category"}) {
+        auto query = parser.parse(text);
+        auto cube_plan = Planner(nullptr, &cubes).plan(*query);
+        ASSERT_EQ(cube_plan.access, AccessPath::CUBE_LOOKUP) << text;
+        EXPECT_EQ(executor.execute(cube_plan, {})->getRows(),
+                  executor.execute(Planner(nullptr).plan(*query), rows)->getRows()) << text;
+    }
+}
+
+// --- Shared Scan Tests ---
+TEST_F(QueryTest, SharedScanMatchesIndividualExecution) {
+    QueryParser parser;
+    auto stats = TableStatistics::compute(sample_data);
+    Planner planner(&stats);
+    std::vector<std::unique_ptr<Query>> queries;
+    queries.push_back(parser.parse("SELECT SUM(value) FROM data WHERE category = 'B'"));
+    queries.push_back(parser.parse("SELECT COUNT(*) FROM data"));
+    queries.push_back(parser.parse("SELECT MAX(value) FROM data SAMPLE RESERVOIR 10"));
+
+    std::vector<PhysicalPlan> plans;
+    for (const auto& query : queries) plans.push_back(planner.plan(*query));
+    auto results = executeShared(plans, sample_data);
+
+    ASSERT_EQ(results.size(), 3);
+    QueryExecutor executor;
+    for (size_t i = 0; i < plans.size(); ++i) {
+        EXPECT_EQ(results[i]->getRows(), executor.execute(plans[i], sample_data)->getRows());
+    }
+    EXPECT_DOUBLE_EQ(std::stod(results[0]->getRows()[0][0]), 450.0);
+}
+
+TEST_F(QueryTest, SharedScanDropsOnlyTheFailingPlan) {
+    QueryParser parser;
+    auto sum = parser.parse("SELECT SUM(value) FROM data WHERE category = 'B'");
+    auto slow = parser.parse("SELECT category, COUNT(*) FROM data GROUP BY category");
+    auto max = parser.parse("SELECT MAX(value) FROM data");
+    std::vector<PhysicalPlan> plans{Planner(nullptr).plan(*sum), Planner(nullptr).plan(*slow),
+                                    Planner(nullptr).plan(*max)};
+    auto token = std::make_shared<CancellationToken>();
+    token->cancel();
+    plans[1].cancellation = token;
+
+    std::vector<std::exception_ptr> errors;
+    auto results = executeShared(plans, sample_data, errors);
+    ASSERT_EQ(errors.size(), 3);
+    EXPECT_FALSE(errors[0]);
+    EXPECT_THROW(std::rethrow_exception(errors[1]), QueryCancelled);
+    EXPECT_FALSE(errors[2]);
+    EXPECT_EQ(results[1], nullptr);
+    EXPECT_DOUBLE_EQ(std::stod(results[0]->getRows()[0][0]), 450.0);
+    EXPECT_DOUBLE_EQ(std::stod(results[2]->getRows()[0][0]), 300.0);
+    EXPECT_THROW(executeShared(plans, sample_data), QueryCancelled);
+}
+
+// --- ORDER BY / LIMIT Tests ---
+TEST_F(QueryTest, ParserResolvesOrderByItems) {
+    QueryParser parser;
+    auto query = parser.parse("SELECT category, SUM(value) AS total, COUNT(*) FROM data GROUP BY category "
+                              "ORDER BY total DESC, count(*), 1 ASC LIMIT 2");
+    ASSERT_EQ(query->order_by.size(), 3);
+    EXPECT_EQ(query->order_by[0].column_index, 1);
+    EXPECT_TRUE(query->order_by[0].descending);
+    EXPECT_EQ(query->order_by[1].column_index, 2);
+    EXPECT_EQ(query->order_by[2].column_index, 0);
+    EXPECT_EQ(query->limit, 2);
+    EXPECT_THROW(parser.parse("SELECT SUM(value) FROM data ORDER BY missing"), ParseError);
+}
+
+TEST_F(QueryTest, ExecutorOrdersAndLimitsGroups) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto top = parser.parse("SELECT category, SUM(value) FROM data GROUP BY category ORDER BY SUM(value) DESC LIMIT 2");
+    auto rows = executor.execute(*top, sample_data)->getRows();
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(rows[0][0], "B"); // 450
+    EXPECT_EQ(rows[1][0], "C"); // 300
+
+    auto sorted = parser.parse("SELECT category, COUNT(*) FROM data GROUP BY category ORDER BY category DESC");
+    rows = executor.execute(*sorted, sample_data)->getRows();
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0][0], "C");
+    EXPECT_EQ(rows[2][0], "A");
+}
+
+// --- HAVING Tests ---
+TEST_F(QueryTest, ExecutorFiltersGroupsWithHaving) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, COUNT(*) AS n, SUM(value) FROM data GROUP BY category "
+                              "HAVING n >= 2 AND SUM(value) > 300 ORDER BY category");
+    auto rows = executor.execute(*query, sample_data)->getRows();
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_EQ(rows[0][0], "B");
+
+    auto by_key = parser.parse("SELECT category, AVG(value) FROM data GROUP BY category HAVING category != ?");
+    by_key->bindParameter(0, std::string("A"));
+    EXPECT_EQ(executor.execute(*by_key, sample_data)->getRows().size(), 2);
+
+    EXPECT_THROW(parser.parse("SELECT category, COUNT(*) FROM data GROUP BY category HAVING SUM(value) > 1"),
+                 ParseError);
+}
+
+// --- Expression Tests ---
+TEST_F(QueryTest, ParserBuildsAggregateExpressions) {
+    QueryParser parser;
+    auto query = parser.parse("SELECT SUM(value * 2), AVG((value - 100) / 10.0) AS scaled FROM data");
+    ASSERT_EQ(query->columns.size(), 2);
+    EXPECT_EQ(query->columns[0].name, "value * 2");
+    EXPECT_EQ(query->columns[0].alias, "SUM(VALUE * 2)");
+    ASSERT_TRUE(query->columns[0].expression);
+    EXPECT_EQ(query->columns[1].name, "(value - 100) / 10");
+
+    auto plain = parser.parse("SELECT SUM((value)) FROM data");
+    EXPECT_EQ(plain->columns[0].name, "value");
+    EXPECT_FALSE(plain->columns[0].expression);
+    EXPECT_THROW(parser.parse("SELECT SUM(value *) FROM data"), ParseError);
+
+    // Constants inside an aggregate are part of the plan cache key
+    EXPECT_NE(normalizeQuery("SELECT SUM(value * 2) FROM data").key,
+              normalizeQuery("SELECT SUM(value * 3) FROM data").key);
+    PlanCache cache;
+    auto cached = cache.get("SELECT SUM(value * 2) FROM data WHERE value > 120");
+    EXPECT_EQ(cached->columns[0].name, "value * 2");
+}
+
+TEST_F(QueryTest, ExecutorEvaluatesAggregateExpressions) {
+    std::vector<DataRow> orders = {
+        { {{"price", "2.5"}, {"qty", "4"}} },
+        { {{"price", "10"}, {"qty", "3"}} },
+        { {{"price", "1"}, {"qty", "0"}} },
+        { {{"price", "oops"}, {"qty", "2"}} },
+    };
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT SUM(price * qty), AVG(price / qty), MAX(-price + 1), COUNT(*) FROM orders "
+                              "ORDER BY SUM(price * qty)");
+    auto rows = executor.execute(*query, orders)->getRows();
+    ASSERT_EQ(rows.size(), 1);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 40.0);                    // non-numeric price skipped
+    EXPECT_NEAR(std::stod(rows[0][1]), (0.625 + 10.0 / 3.0) / 2, 1e-6); // division by zero skipped
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][2]), 0.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][3]), 4.0);
+
+    // Expressions never roll up from a cube; equal expressions share one input
+    CubeRegistry cubes;
+    cubes.declare({"by_category", "data", {"category"}, {"value"}}, sample_data);
+    auto fused = parser.parse("SELECT SUM(value / 100.0), AVG(value/100.0) FROM data");
+    auto plan = Planner(nullptr, &cubes).plan(*fused);
+    EXPECT_EQ(plan.access, AccessPath::TABLE_SCAN);
+    EXPECT_EQ(plan.input_columns.size(), 1);
+    rows = executor.execute(plan, sample_data)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 10.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 2.0);
+}
+
+// --- Join Tests ---
+TEST_F(QueryTest, ParserResolvesJoinSides) {
+    QueryParser parser;
+    auto query = parser.parse("SELECT region, SUM(value) FROM data JOIN regions ON regions.code = data.category "
+                              "GROUP BY region");
+    ASSERT_TRUE(query->join);
+    EXPECT_EQ(query->join->type, JoinType::INNER);
+    EXPECT_EQ(query->join->table, "regions");
+    EXPECT_EQ(query->join->probe_column, "category");
+    EXPECT_EQ(query->join->build_column, "code");
+
+    auto semi = parser.parse("SELECT COUNT(*) FROM data SEMI JOIN regions ON category = code");
+    EXPECT_EQ(semi->join->type, JoinType::SEMI);
+    EXPECT_EQ(semi->join->probe_column, "category");
+    EXPECT_THROW(parser.parse("SELECT COUNT(*) FROM data JOIN regions ON other.x = code"), ParseError);
+}
+
+TEST_F(QueryTest, HashJoinFiltersProbeRowsAndAggregates) {
+    std::vector<DataRow> regions = {
+        { {{"code", "A"}, {"region", "north"}} },
+        { {{"code", "B"}, {"region", "south"}} },
+        { {{"code", "B"}, {"region", "east"}} },
+    };
+    QueryParser parser;
+    auto query = parser.parse("SELECT region, SUM(value), COUNT(*) FROM data JOIN regions ON category = code "
+                              "GROUP BY region ORDER BY region");
+    auto plan = Planner(nullptr).plan(*query);
+    auto rows = executeJoin(plan, sample_data, regions)->getRows();
+    ASSERT_EQ(rows.size(), 3);
+    EXPECT_EQ(rows[0][0], "east");
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 450.0);
+    EXPECT_EQ(rows[1][0], "north");
+    EXPECT_DOUBLE_EQ(std::stod(rows[1][1]), 250.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[2][2]), 2.0);
+
+    // A semi join counts each matching probe row once
+    auto semi = parser.parse("SELECT COUNT(*) FROM data SEMI JOIN regions ON category = code");
+    rows = executeJoin(Planner(nullptr).plan(*semi), sample_data, regions)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 4.0);
+
+    HashJoin join(*query->join, regions);
+    std::vector<DataRow> out;
+    join.probe(sample_data.data(), sample_data.data() + sample_data.size(), out);
+    EXPECT_EQ(out.size(), 6);
+    EXPECT_EQ(join.buildKeys(), 2);
+    EXPECT_LE(join.filteredRows(), 1); // only the "C" row can be rejected early
+
+    QueryExecutor executor;
+    EXPECT_THROW(executor.execute(*query, sample_data), std::invalid_argument);
+}
+
+// --- Universe Sampling Tests ---
+TEST_F(QueryTest, ParserHandlesUniverseSampling) {
+    QueryParser parser;
+    auto joined = parser.parse("SELECT COUNT(*) FROM data JOIN regions ON category = code SAMPLE UNIVERSE 10%");
+    EXPECT_EQ(joined->sampling.method, SamplingMethod::UNIVERSE);
+    EXPECT_EQ(joined->sampling.universe_column, "category");
+    EXPECT_DOUBLE_EQ(joined->sampling.rate, 0.1);
+
+    auto single = parser.parse("SELECT SUM(value) FROM data SAMPLE UNIVERSE BY category 50%");
+    EXPECT_EQ(single->sampling.universe_column, "category");
+    EXPECT_THROW(parser.parse("SELECT COUNT(*) FROM data SAMPLE UNIVERSE 10%"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT COUNT(*) FROM data JOIN regions ON category = code "
+                              "SAMPLE UNIVERSE BY value 10%"), ParseError);
+}
+
+TEST_F(QueryTest, UniverseSampledJoinKeepsMatchingKeysOnBothSides) {
+    std::vector<DataRow> facts, dims;
+    for (int k = 0; k < 2000; ++k) {
+        dims.push_back({ {{"id", std::to_string(k)}, {"group", k % 2 ? "odd" : "even"}} });
+        for (int r = 0; r < 5; ++r) {
+            facts.push_back({ {{"key", std::to_string(k)}, {"value", "1"}} });
+        }
+    }
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM facts JOIN dims ON key = id SAMPLE UNIVERSE 20%");
+    auto rows = executeJoin(Planner().plan(*query), facts, dims)->getRows();
+
+    // Independent 20% samples of both sides would keep ~4% of the join;
+    // a universe sample keeps ~20% and scales back to the full 10000 rows.
+    EXPECT_NEAR(std::stod(rows[0][0]), 10000.0, 1500.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), std::stod(rows[0][1]));
+
+    // Lower rates select subsets of higher-rate samples
+    UniverseSampler low(0.1, ColumnKey{"id"}), high(0.3, ColumnKey{"id"});
+    for (const auto& row : dims) {
+        if (low.accept(&row)) {
+            EXPECT_TRUE(high.accept(&row));
+        }
+    }
+}
+
+// --- Catalog Tests ---
+TEST_F(QueryTest, CatalogResolvesTablesNamedInFrom) {
+    Catalog catalog(0.5);
+    catalog.addTable("data", {"category", "value"}, sample_data);
+    catalog.addTable("regions", {"code", "region"}, {
+        { {{"code", "A"}, {"region", "north"}} },
+        { {{"code", "C"}, {"region", "south"}} },
+    });
+    auto snapshot = catalog.snapshot();
+    EXPECT_EQ(snapshot->tableNames(), (std::vector<std::string>{"data", "regions"}));
+    EXPECT_EQ(snapshot->table("data").statistics.row_count, 5);
+
+    QueryParser parser;
+    auto joined = parser.parse("SELECT region, SUM(value) FROM data JOIN regions ON category = code "
+                               "GROUP BY region ORDER BY region");
+    auto rows = executeQuery(snapshot->plan(*joined), *snapshot)->getRows();
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 250.0);
+
+    auto missing = parser.parse("SELECT COUNT(*) FROM nowhere");
+    EXPECT_THROW(snapshot->plan(*missing), std::invalid_argument);
+
+    // Samples at or below the stored rate scan the stored sample
+    auto sampled = parser.parse("SELECT SUM(value) FROM data SAMPLE 20%");
+    auto plan = snapshot->plan(*sampled);
+    EXPECT_DOUBLE_EQ(plan.input_fraction, 0.5);
+    EXPECT_EQ(&snapshot->scanInput(plan), &snapshot->table("data").stored_sample);
+    auto exact = parser.parse("SELECT SUM(value) FROM data");
+    EXPECT_EQ(&snapshot->scanInput(snapshot->plan(*exact)), &snapshot->table("data").rows);
+
+    uint64_t before = catalog.version();
+    catalog.declareCube({"by_category", "data", {"category"}, {"value"}});
+    EXPECT_TRUE(catalog.dropTable("data"));
+    EXPECT_NE(catalog.version(), before);
+    EXPECT_EQ(catalog.snapshot()->getCubes().size(), 0);
+    EXPECT_TRUE(snapshot->find("data")); // the snapshot keeps its version
+}
+
+TEST_F(QueryTest, SnapshotsKeepTheirVersionWhileRowsAreAppended) {
+    Catalog catalog(0.0, 3);
+    catalog.addTable("data", {"category", "value"}, sample_data);
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM data WHERE value > 0");
+
+    auto before = catalog.snapshot();
+    catalog.appendRows("data", {{{{"category", "A"}, {"value", "1"}}}, {{{"category", "A"}, {"value", "2"}}},
+                                {{{"category", "B"}, {"value", "3"}}}, {{{"category", "B"}, {"value", "4"}}}});
+    auto after = catalog.snapshot();
+    EXPECT_EQ(before->table("data").rows.segmentCount(), 1);
+    EXPECT_EQ(after->table("data").rows.segmentCount(), 3); // loaded, one sealed buffer, the active one
+    EXPECT_GT(catalog.retiredVersions(), 0);
+
+    auto old_rows = executeQuery(before->plan(*query), *before)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(old_rows[0][0]), 5.0);
+    EXPECT_DOUBLE_EQ(std::stod(old_rows[0][1]), 1000.0);
+    auto new_rows = executeQuery(after->plan(*query), *after)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(new_rows[0][0]), 9.0);
+    EXPECT_DOUBLE_EQ(std::stod(new_rows[0][1]), 1010.0);
+
+    // Appending to the active buffer leaves the last snapshot's rows alone
+    catalog.appendRows("data", {{{{"category", "C"}, {"value", "5"}}}});
+    EXPECT_DOUBLE_EQ(std::stod(executeQuery(after->plan(*query), *after)->getRows()[0][0]), 9.0);
+
+    before = catalog.snapshot();
+    after = catalog.snapshot();
+    catalog.appendRows("data", {});
+    EXPECT_LE(catalog.retiredVersions(), 1); // only versions the live snapshots pin
+}
+
+// --- Window Function Tests ---
+TEST_F(QueryTest, ParserBuildsWindowSpecs) {
+    QueryParser parser;
+    auto query = parser.parse("SELECT category, value, ROW_NUMBER() OVER (PARTITION BY category ORDER BY value DESC) AS rn, "
+                              "AVG(value) OVER (ORDER BY value ROWS 2 PRECEDING) FROM data");
+    ASSERT_TRUE(query->columns[2].window);
+    EXPECT_EQ(query->columns[2].alias, "rn");
+    EXPECT_EQ(query->columns[2].window->function, WindowFunction::ROW_NUMBER);
+    EXPECT_TRUE(query->columns[2].window->order_by[0].descending);
+    EXPECT_EQ(query->columns[3].window->preceding, 2);
+    EXPECT_EQ(query->columns[3].alias, "AVG(VALUE)");
+
+    EXPECT_THROW(parser.parse("SELECT SUM(value), ROW_NUMBER() OVER () FROM data"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT MAX(value) OVER (ROWS 2 PRECEDING) FROM data"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT SUM(value) OVER (ROWS 1.5 PRECEDING) FROM data"), ParseError);
+    EXPECT_THROW(parser.parse("SELECT SUM(value) OVER (ROWS 1" + std::string(400, '0') + " PRECEDING) FROM data"),
+                 ParseError);
+    EXPECT_THROW(parser.parse("SELECT ROW_NUMBER() OVER () FROM data SAMPLE 10%"), ParseError);
+}
+
+TEST_F(QueryTest, ExecutorComputesWindowFunctionsPerPartition) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, value, ROW_NUMBER() OVER (PARTITION BY category ORDER BY value), "
+                              "SUM(value) OVER (PARTITION BY category ORDER BY value) FROM data");
+    auto result = executor.execute(*query, sample_data);
+    auto rows = result->getRows();
+    ASSERT_EQ(rows.size(), 5);
+    // Partitions in first-seen order (A, B, C), each sorted by value
+    EXPECT_EQ(rows[0], (std::vector<std::string>{"A", "100", std::to_string(1.0), std::to_string(100.0)}));
+    EXPECT_EQ(rows[1], (std::vector<std::string>{"A", "150", std::to_string(2.0), std::to_string(250.0)}));
+    EXPECT_EQ(rows[3][3], std::to_string(450.0));
+    EXPECT_EQ(rows[4][2], std::to_string(1.0));
+    EXPECT_DOUBLE_EQ(std::get<double>(result->getValues()[1][2]), 2.0); // native, not text
+
+    auto counted = parser.parse("SELECT value, COUNT(value) OVER (ORDER BY value) FROM data");
+    EXPECT_DOUBLE_EQ(std::get<double>(executor.execute(*counted, sample_data)->getValues()[4][1]), 5.0);
+
+    auto moving = parser.parse("SELECT value, AVG(value) OVER (ORDER BY value ROWS 1 PRECEDING) AS m FROM data "
+                               "WHERE value > 100 ORDER BY m DESC LIMIT 2");
+    rows = executor.execute(*moving, sample_data)->getRows();
+    ASSERT_EQ(rows.size(), 2);
+    EXPECT_EQ(rows[0][0], "300");
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 275.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[1][1]), 225.0);
+}
+
+// --- Result Materialization Tests ---
+TEST_F(QueryTest, ResultKeepsNativeValuesUntilFormatted) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, SUM(value) FROM data GROUP BY category ORDER BY category");
+    auto result = executor.execute(*query, sample_data);
+    const auto& values = result->getValues();
+    ASSERT_EQ(result->rowCount(), 3);
+    EXPECT_EQ(std::get<std::string>(values[0][0]), "A");
+    EXPECT_DOUBLE_EQ(std::get<double>(values[0][1]), 250.0);
+    EXPECT_EQ(result->getRows()[0][1], "250.000000");
+    EXPECT_EQ(&result->getRows(), &result->getRows()); // formatted once
+}
+
+// --- Result Export Tests ---
+TEST_F(QueryTest, ColumnarResultRoundTripsThroughBinaryFormat) {
+    QueryResult result;
+    result.setColumnNames({"category", "SUM(value)"});
+    result.setApproximate(true);
+    result.addRow(std::vector<Value>{std::string("A"), 250.0});
+    result.addRow(std::vector<Value>{std::string("B"), std::string("NULL")});
+    result.addRow(std::vector<Value>{std::string("C"), -1.5});
+
+    ColumnarResult columnar = ColumnarResult::fromResult(result);
+    ASSERT_EQ(columnar.columns.size(), 2);
+    EXPECT_EQ(columnar.columns[0].type, ColumnType::UTF8);
+    EXPECT_EQ(columnar.columns[1].type, ColumnType::FLOAT64);
+    EXPECT_EQ(columnar.columns[1].nullCount(), 1);
+
+    std::string encoded;
+    writeBinary(columnar, encoded);
+    ColumnarResult decoded = readBinary(encoded);
+    EXPECT_EQ(decoded.row_count, 3);
+    EXPECT_TRUE(decoded.approximate);
+    EXPECT_EQ(decoded.columns[1].name, "SUM(value)");
+    EXPECT_EQ(decoded.columns[0].textAt(2), "C");
+    EXPECT_DOUBLE_EQ(decoded.columns[1].numbers[0], 250.0);
+    EXPECT_TRUE(decoded.columns[1].isNull(1));
+    EXPECT_DOUBLE_EQ(decoded.columns[1].numbers[2], -1.5);
+
+    EXPECT_THROW(readBinary(encoded.substr(0, encoded.size() - 4)), std::runtime_error);
+    EXPECT_THROW(readBinary("CSV!"), std::runtime_error);
+}
+
+TEST_F(QueryTest, BinaryFormatRejectsCorruptCountsAndOffsets) {
+    QueryResult result;
+    result.setColumnNames({"category"});
+    for (const char* name : {"A", "B", "C"}) result.addRow(std::vector<Value>{std::string(name)});
+    ColumnarResult columnar = ColumnarResult::fromResult(result);
+    std::string encoded;
+    writeBinary(columnar, encoded);
+    ASSERT_NO_THROW(readBinary(encoded));
+
+    // Header is 21 bytes, then type, name length and "category"; offsets follow
+    const size_t rows_at = 8, type_at = 21, offsets_at = 34;
+    std::string huge_rows = encoded;
+    huge_rows[rows_at + 5] = 1; // 2^40 rows cannot fit the remaining bytes
+    EXPECT_THROW(readBinary(huge_rows), std::runtime_error);
+    std::string bad_type = encoded;
+    bad_type[type_at] = 7;
+    EXPECT_THROW(readBinary(bad_type), std::runtime_error);
+    std::string decreasing = encoded;
+    decreasing[offsets_at + 4] = 3; // offsets 0, 3, 2, 3
+    EXPECT_THROW(readBinary(decreasing), std::runtime_error);
+    std::string past_text = encoded;
+    past_text[offsets_at + 12] = 4; // last offset beyond the 3-byte text
+    EXPECT_THROW(readBinary(past_text), std::runtime_error);
+
+    // The writer refuses a column whose offsets do not delimit its text
+    columnar.columns[0].offsets.back() = 10;
+    std::string refused;
+    EXPECT_THROW(writeBinary(columnar, refused), std::invalid_argument);
+    EXPECT_TRUE(refused.empty());
+    EXPECT_THROW(writeArrowStream(columnar, refused), std::invalid_argument);
+}
+
+TEST_F(QueryTest, ColumnarResultTakesAggregateTypesFromTheQuery) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, COUNT(*) FROM data WHERE value > 1000 GROUP BY category");
+    auto result = executor.execute(*query, sample_data);
+    ASSERT_EQ(result->rowCount(), 0);
+    ColumnarResult columnar = ColumnarResult::fromResult(*result, *query);
+    EXPECT_EQ(columnar.columns[0].type, ColumnType::UTF8);
+    EXPECT_EQ(columnar.columns[1].type, ColumnType::FLOAT64);
+    EXPECT_EQ(ColumnarResult::fromResult(*result).columns[1].type, ColumnType::UTF8); // nothing to infer from
+}
+
+TEST_F(QueryTest, ArrowStreamHasSchemaBatchAndEndMarker) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, COUNT(*) FROM data GROUP BY category");
+    auto result = executor.execute(*query, sample_data);
+    std::string stream;
+    writeArrowStream(ColumnarResult::fromResult(*result, *query), stream);
+
+    auto u32 = [&](size_t pos) {
+        uint32_t v = 0;
+        for (int i = 3; i >= 0; --i) v = (v << 8) | static_cast<uint8_t>(stream[pos + i]);
+        return v;
+    };
+    // Schema message: continuation marker, 8-byte aligned metadata, no body
+    ASSERT_GE(stream.size(), 16u);
+    EXPECT_EQ(u32(0), 0xFFFFFFFFu);
+    uint32_t schema_length = u32(4);
+    EXPECT_EQ(schema_length % 8, 0u);
+    EXPECT_NE(stream.find("category", 8), std::string::npos);
+
+    // Record batch message follows, and the stream ends with an empty message
+    size_t batch = 8 + schema_length;
+    EXPECT_EQ(u32(batch), 0xFFFFFFFFu);
+    EXPECT_EQ(stream.size() % 8, 0u);
+    EXPECT_EQ(u32(stream.size() - 8), 0xFFFFFFFFu);
+    EXPECT_EQ(u32(stream.size() - 4), 0u);
+}
+
+TEST_F(QueryTest, ResultWriterFormatsTableCsvTsvAndJsonLines) {
+    QueryResult result;
+    result.setColumnNames({"name", "total"});
+    result.addRow(std::vector<Value>{std::string("plain"), 2.0});
+    result.addRow(std::vector<Value>{std::string("a,\"b\"\tc"), 0.5});
+    result.addRow(std::vector<Value>{std::string("none"), std::string("NULL")});
+
+    std::string table;
+    ResultWriter().append(result, table);
+    EXPECT_EQ(table.substr(0, table.find('\n', table.find('\n') + 1) + 1),
+              "name     total     \n-------------------\n");
+    EXPECT_NE(table.find("plain    2.000000  \n"), std::string::npos);
+
+    std::string csv;
+    ResultWriter(OutputFormat::CSV).append(result, csv);
+    EXPECT_EQ(csv, "name,total\nplain,2.000000\n\"a,\"\"b\"\"\tc\",0.500000\nnone,NULL\n");
+
+    std::string tsv;
+    ResultWriter(parseOutputFormat("tsv")).append(result, tsv);
+    EXPECT_NE(tsv.find("a,\"b\"\\tc\t0.500000\n"), std::string::npos);
+
+    std::string json;
+    ResultWriter(OutputFormat::JSON_LINES).append(result, json);
+    EXPECT_EQ(json, "{\"name\":\"plain\",\"total\":2}\n"
+                    "{\"name\":\"a,\\\"b\\\"\\tc\",\"total\":0.5}\n"
+                    "{\"name\":\"none\",\"total\":null}\n");
+
+    EXPECT_THROW(parseOutputFormat("xml"), std::invalid_argument);
+}
+
+// --- Cancellation Tests ---
+TEST_F(QueryTest, CancelledPlansStopBetweenBatches) {
+    QueryParser parser;
+    QueryExecutor executor;
+    auto query = parser.parse("SELECT category, SUM(value) FROM data GROUP BY category");
+    auto plan = Planner(nullptr).plan(*query);
+    auto token = std::make_shared<CancellationToken>();
+    plan.cancellation = token;
+    EXPECT_EQ(executor.execute(plan, sample_data)->rowCount(), 3);
+
+    token->cancel();
+    EXPECT_THROW(executor.execute(plan, sample_data), QueryCancelled);
+
+    auto window_query = parser.parse("SELECT value, ROW_NUMBER() OVER (ORDER BY value) FROM data");
+    auto window = Planner(nullptr).plan(*window_query);
+    window.cancellation = token;
+    EXPECT_THROW(executor.execute(window, sample_data), QueryCancelled);
+
+    auto join_query = parser.parse("SELECT COUNT(*) FROM data SEMI JOIN data2 ON category = category");
+    auto join = Planner(nullptr).plan(*join_query);
+    join.cancellation = token;
+    EXPECT_THROW(executeJoin(join, sample_data, sample_data), QueryCancelled);
+}
+
+TEST_F(QueryTest, ExpiredDeadlineReportsTimeout) {
+    auto token = CancellationToken::withTimeout(std::chrono::milliseconds(0));
+    EXPECT_TRUE(token->isCancelled());
+    try {
+        token->throwIfCancelled();
+        FAIL() << "expected QueryCancelled";
+    } catch (const QueryCancelled& e) {
+        EXPECT_EQ(std::string(e.what()), "Query timed out after 0ms");
+    }
+    EXPECT_FALSE(CancellationToken::withTimeout(std::chrono::hours(1))->isCancelled());
+    EXPECT_FALSE(CancellationToken().isCancelled());
+}
+
+// --- Streaming Ingest Tests ---
+TEST_F(QueryTest, AppendedBatchesExtendStatisticsAndCubes) {
+    Catalog catalog(1.0);
+    catalog.addTable("data", {"category", "value"}, sample_data);
+    catalog.declareCube({"by_category", "data", {"category"}, {"value"}});
+    uint64_t before = catalog.version();
+
+    EXPECT_EQ(catalog.appendRows("data", {{{{"category", "D"}, {"value", "900"}}},
+                                          {{{"category", "A"}, {"value", "-50"}}}}), 2);
+    EXPECT_NE(catalog.version(), before);
+    auto snapshot = catalog.snapshot();
+    const Table& table = snapshot->table("data");
+    EXPECT_EQ(table.rows.size(), 7);
+    EXPECT_EQ(table.stored_sample.size(), 7);
+    EXPECT_EQ(table.statistics.row_count, 7);
+    EXPECT_DOUBLE_EQ(table.statistics.column("value")->max, 900.0);
+    EXPECT_DOUBLE_EQ(table.statistics.column("value")->min, -50.0);
+    EXPECT_NEAR(table.statistics.column("category")->distinct_estimate, 4.0, 0.5);
+
+    QueryParser parser;
+    auto query = parser.parse("SELECT category, SUM(value) FROM data GROUP BY category ORDER BY category");
+    auto plan = snapshot->plan(*query);
+    EXPECT_EQ(plan.access, AccessPath::CUBE_LOOKUP);
+    auto rows = executeQuery(plan, *snapshot)->getRows();
+    ASSERT_EQ(rows.size(), 4);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 200.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[3][1]), 900.0);
+
+    EXPECT_THROW(catalog.appendRows("nowhere", {}), std::invalid_argument);
+}
+
+TEST_F(QueryTest, StreamIngestorAppendsCsvInMicroBatches) {
+    Catalog catalog;
+    IngestOptions options;
+    options.batch_rows = 2;
+    options.max_delay = std::chrono::hours(1);
+
+    std::istringstream first("category,value\nA,1\nB,2\n\nC,3\n");
+    StreamIngestor ingestor(catalog, "events", options);
+    EXPECT_EQ(ingestor.run(first), 3);
+    EXPECT_EQ(catalog.snapshot()->table("events").schema, (std::vector<std::string>{"category", "value"}));
+    EXPECT_EQ(ingestor.batchesCommitted(), 2);
+
+    // An existing table skips a repeated header and keeps its column order
+    std::istringstream second("category,value\nD,4\n");
+    EXPECT_EQ(StreamIngestor(catalog, "events", options).run(second), 1);
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM events");
+    auto snapshot = catalog.snapshot();
+    auto rows = executeQuery(snapshot->plan(*query), *snapshot)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 4.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 10.0);
+
+    EXPECT_THROW(StreamIngestor(catalog, "events", IngestOptions{0}), std::invalid_argument);
+}
+
+TEST_F(QueryTest, ParserThreadsFeedOneCommitter) {
+    Catalog catalog(0.0);
+    std::string input = "id,value\n";
+    for (int i = 1; i <= 20000; ++i) input += std::to_string(i) + ",1\n";
+    std::istringstream in(input);
+
+    IngestOptions options;
+    options.batch_rows = 500;
+    options.parser_threads = 4;
+    options.queue_batches = 2;
+    StreamIngestor ingestor(catalog, "events", options);
+    EXPECT_EQ(ingestor.run(in), 20000);
+    EXPECT_EQ(ingestor.rowsIngested(), 20000);
+
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(id), SUM(value) FROM events");
+    auto snapshot = catalog.snapshot();
+    auto rows = executeQuery(snapshot->plan(*query), *snapshot)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 20000.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 20000.0 * 20001.0 / 2.0);
+
+    options.parser_threads = 0;
+    EXPECT_THROW(StreamIngestor(catalog, "events", options), std::invalid_argument);
+}
+
+TEST_F(QueryTest, QueriesSeeWholeBatchesWhileIngesting) {
+    Catalog catalog(0.0);
+    catalog.addTable("events", {"value"}, {});
+    constexpr size_t BATCH = 100;
+    std::string input;
+    for (size_t i = 0; i < 50 * BATCH; ++i) input += "1\n";
+
+    std::thread writer([&] {
+        std::istringstream in(input);
+        IngestOptions options;
+        options.batch_rows = BATCH;
+        StreamIngestor(catalog, "events", options).run(in);
+    });
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM events");
+    double count = 0;
+    while (count < 50 * BATCH) {
+        auto snapshot = catalog.snapshot();
+        auto rows = executeQuery(snapshot->plan(*query), *snapshot)->getRows();
+        count = std::stod(rows[0][0]);
+        EXPECT_EQ(static_cast<size_t>(count) % BATCH, 0);
+        if (count > 0) {
+            EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), count);
+        }
+    }
+    writer.join();
+}
+
+// --- Compaction Tests ---
+TEST_F(QueryTest, ZoneMapsRuleOutSegmentsByRange) {
+    ZoneMap zones = ZoneMap::build(sample_data.data(), sample_data.data() + sample_data.size());
+    QueryParser parser;
+    auto mayMatch = [&](const std::string& where) {
+        return zones.mayMatch(*parser.parse("SELECT COUNT(*) FROM data WHERE " + where)->where);
+    };
+    EXPECT_TRUE(mayMatch("value >= 300"));
+    EXPECT_FALSE(mayMatch("value > 300"));
+    EXPECT_FALSE(mayMatch("value < 100"));
+    EXPECT_TRUE(mayMatch("value = 150"));
+    EXPECT_FALSE(mayMatch("category = 'D'"));
+    EXPECT_TRUE(mayMatch("category = 'D' OR value < 101"));
+    EXPECT_FALSE(mayMatch("category = 'A' AND value > 1000"));
+    EXPECT_FALSE(mayMatch("category > 5"));  // no numeric categories
+    EXPECT_FALSE(mayMatch("missing = 1"));
+}
+
+TEST_F(QueryTest, CompactionMergesSmallSegmentsWithoutChangingResults) {
+    Catalog catalog(0.0, 2);
+    catalog.addTable("data", {"category", "value"}, sample_data);
+    for (int i = 0; i < 10; i += 2) {
+        catalog.appendRows("data", {{{{"category", "D"}, {"value", std::to_string(1000 + i)}}},
+                                    {{{"category", "D"}, {"value", std::to_string(1001 + i)}}}});
+    }
+    QueryParser parser;
+    auto high = parser.parse("SELECT COUNT(*), SUM(value) FROM data WHERE value > 900");
+    auto all = parser.parse("SELECT category, COUNT(*) FROM data GROUP BY category");
+    auto before = catalog.snapshot();
+    EXPECT_EQ(before->table("data").rows.segmentCount(), 6); // loaded, five full buffers
+
+    CompactionOptions options;
+    options.small_segment_rows = 4;
+    options.target_segment_rows = 6;
+    EXPECT_TRUE(catalog.compact("data", options));
+    EXPECT_FALSE(catalog.compact("data", options)); // nothing left to do
+    auto after = catalog.snapshot();
+    const SegmentedRows& rows = after->table("data").rows;
+    ASSERT_EQ(rows.segmentCount(), 3); // loaded, 6 merged rows, 4 merged rows
+    EXPECT_EQ(rows.size(), 15);
+    EXPECT_EQ(after->version(), before->version());
+
+    // The loaded segment's zone map rules it out for the high values
+    auto kept = rows.rowSet([&](const ZoneMap& zones) { return zones.mayMatch(*high->where); });
+    EXPECT_EQ(kept.size(), 10);
+    for (const auto* query : {high.get(), all.get()}) {
+        EXPECT_EQ(executeQuery(after->plan(*query), *after)->getRows(),
+                  executeQuery(before->plan(*query), *before)->getRows());
+    }
+    auto shared = executeShared({after->plan(*high), after->plan(*all)}, *after);
+    EXPECT_DOUBLE_EQ(std::stod(shared[0]->getRows()[0][0]), 10.0);
+    EXPECT_EQ(shared[1]->getRows().size(), 4);
+
+    // Appends continue after the merged segments
+    catalog.appendRows("data", {{{{"category", "D"}, {"value", "2000"}}}});
+    auto latest = catalog.snapshot();
+    EXPECT_EQ(latest->table("data").rows.segmentCount(), 4);
+    EXPECT_DOUBLE_EQ(std::stod(executeQuery(latest->plan(*high), *latest)->getRows()[0][0]), 11.0);
+
+    // A plan whose segments were already rewritten is not applied
+    auto plan = before->table("data").rows.planCompaction(options);
+    EXPECT_FALSE(plan.empty());
+    EXPECT_FALSE(latest->table("data").rows.compacted(before->table("data").rows, std::move(plan)));
+}
+
+TEST_F(QueryTest, CompactorMergesSegmentsWhileRowsArrive) {
+    Catalog catalog(0.5, 8);
+    catalog.addTable("events", {"value"}, {});
+    CompactionOptions options;
+    options.small_segment_rows = 64;
+    options.target_segment_rows = 256;
+    Compactor compactor(catalog, options, std::chrono::milliseconds(1));
+    compactor.start();
+    for (int i = 0; i < 200; ++i) {
+        catalog.appendRows("events", std::vector<DataRow>(8, DataRow{{{"value", "1"}}}));
+    }
+    while (compactor.compactions() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    compactor.stop();
+    compactor.runOnce();
+
+    // Adjacent sealed segments are never both small
+    auto snapshot = catalog.snapshot();
+    const auto& parts = snapshot->table("events").rows.getParts();
+    EXPECT_LT(parts.size(), 200);
+    for (size_t i = 1; i < parts.size(); ++i) {
+        EXPECT_TRUE(parts[i - 1].rows >= 64 || parts[i].rows >= 64 || i + 1 == parts.size());
+    }
+    QueryParser parser;
+    auto query = parser.parse("SELECT COUNT(*), SUM(value) FROM events WHERE value = 1");
+    auto rows = executeQuery(snapshot->plan(*query), *snapshot)->getRows();
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][0]), 1600.0);
+    EXPECT_DOUBLE_EQ(std::stod(rows[0][1]), 1600.0);
+}
@@ -0,0 +1,221 @@
+#include <gtest/gtest.h>
+#include "server/query_server.hpp"
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <future>
+#include <chrono>
+#include <unistd.h>
+
+using namespace aqe::query;
+using namespace aqe::server;
+
+class ServerTest : public ::testing::Test {
+protected:
+    Catalog catalog{0.0};
+    std::string socket_path;
+
+    void SetUp() override {
+        std::vector<DataRow> rows;
+        rows.push_back({ {{"category", "A"}, {"value", "100"}} });
+        rows.push_back({ {{"category", "B"}, {"value", "200"}} });
+        rows.push_back({ {{"category", "A"}, {"value", "150"}} });
+        catalog.addTable("data", {"category", "value"}, std::move(rows));
+        socket_path = "/tmp/aqe_server_test_" + std::to_string(::getpid()) + ".sock";
+    }
+};
+
+TEST_F(ServerTest, AnswersFramedQueriesOverUnixSocket) {
+    ServerOptions options;
+    options.unix_path = socket_path;
+    QueryServer server(catalog, options);
+    server.listen();
+    std::thread loop([&] { server.run(); });
+
+    {
+        QueryClient client = QueryClient::connectUnix(socket_path);
+        auto response = client.query("SELECT COUNT(*) FROM data");
+        EXPECT_EQ(response.status, protocol::OK);
+        EXPECT_EQ(response.payload, "{\"COUNT(*)\":3}\n");
+
+        // Pipelined requests are answered in order; errors keep the connection
+        client.send("SELECT SUM(value) FROM data WHERE category = 'A'");
+        client.send("SELECT nonsense");
+        client.send("SELECT COUNT(*) FROM missing");
+        EXPECT_EQ(client.receive().payload, "{\"SUM(VALUE)\":250}\n");
+        EXPECT_EQ(client.receive().status, protocol::ERROR);
+        auto unknown = client.receive();
+        EXPECT_EQ(unknown.status, protocol::ERROR);
+        EXPECT_NE(unknown.payload.find("missing"), std::string::npos);
+    }
+
+    server.stop();
+    loop.join();
+}
+
+TEST_F(ServerTest, ServesManyClientsOverLoopbackTcp) {
+    ServerOptions options;
+    options.format = OutputFormat::CSV;
+    QueryServer server(catalog, options);
+    server.listen();
+    ASSERT_NE(server.port(), 0);
+    std::thread loop([&] { server.run(); });
+
+    std::vector<QueryClient> clients;
+    for (int i = 0; i < 20; ++i) clients.push_back(QueryClient::connectTcp(server.port()));
+    for (auto& client : clients) client.send("SELECT category, COUNT(*) FROM data GROUP BY category ORDER BY category");
+    for (auto& client : clients) {
+        auto response = client.receive();
+        EXPECT_EQ(response.status, protocol::OK);
+        EXPECT_EQ(response.payload, "category,COUNT(*)\nA,2.000000\nB,1.000000\n");
+    }
+
+    // An oversized frame closes only the offending connection
+    std::string huge;
+    protocol::appendU32(huge, 1u << 30);
+    clients[0].writeAll(huge);
+    EXPECT_THROW(clients[0].receive(), std::runtime_error);
+    EXPECT_EQ(clients[1].query("SELECT COUNT(*) FROM data").status, protocol::OK);
+
+    server.stop();
+    loop.join();
+}
+
+TEST_F(ServerTest, PipelinedResponsesKeepRequestOrderAcrossPriorities) {
+    ServerOptions options;
+    options.unix_path = socket_path;
+    options.admission.max_in_flight = 4;
+    QueryServer server(catalog, options);
+    server.listen();
+    std::thread loop([&] { server.run(); });
+
+    QueryClient client = QueryClient::connectUnix(socket_path);
+    std::vector<std::string> expected;
+    for (int i = 0; i < 10; ++i) {
+        // Alternate exact (batch) and sampled (interactive) queries
+        client.send("SELECT MAX(value) FROM data WHERE value > " + std::to_string(i * 20));
+        expected.push_back(i * 20 < 200 ? "{\"MAX(VALUE)\":200}\n" : "{\"MAX(VALUE)\":null}\n");
+        client.send("SELECT COUNT(*) FROM data SAMPLE 100%");
+        expected.push_back("{\"COUNT(*)\":3}\n");
+    }
+    for (const auto& payload : expected) {
+        auto response = client.receive();
+        EXPECT_EQ(response.status, protocol::OK);
+        EXPECT_EQ(response.payload, payload);
+    }
+
+    server.stop();
+    loop.join();
+}
+
+TEST_F(ServerTest, QueriesPastTheirTimeoutFailWithoutStoppingTheServer) {
+    std::vector<DataRow> rows(200000);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        rows[i].values = {{"id", std::to_string(i)}, {"value", std::to_string(i % 1000)}};
+    }
+    catalog.addTable("big", {"id", "value"}, std::move(rows));
+
+    ServerOptions options;
+    options.unix_path = socket_path;
+    options.query_timeout = std::chrono::milliseconds(1);
+    QueryServer server(catalog, options);
+    server.listen();
+    std::thread loop([&] { server.run(); });
+
+    QueryClient client = QueryClient::connectUnix(socket_path);
+    auto response = client.query("SELECT id, SUM(value) FROM big GROUP BY id");
+    EXPECT_EQ(response.status, protocol::ERROR);
+    EXPECT_NE(response.payload.find("timed out"), std::string::npos);
+    EXPECT_EQ(client.query("SELECT nonsense").status, protocol::ERROR); // connection still served
+
+    server.stop();
+    loop.join();
+}
+
+// --- Admission Control Tests ---
+namespace {
+
+// Polls until `done` holds or a second passes.
+template <typename Predicate>
+bool eventually(Predicate done) {
+    for (int i = 0; i < 1000 && !done(); ++i) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return done();
+}
+
+} // namespace
+
+TEST(AdmissionControllerTest, LimitsQueriesInFlightAndMemory) {
+    std::atomic<int> running{0}, peak{0}, finished{0};
+    auto job = [&] {
+        int now = ++running;
+        int seen = peak.load();
+        while (now > seen && !peak.compare_exchange_weak(seen, now)) {}
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        --running;
+        ++finished;
+    };
+    {
+        AdmissionController controller({3, size_t(1) << 20});
+        for (int i = 0; i < 12; ++i) controller.submit(QueryPriority::INTERACTIVE, 100, job);
+        ASSERT_TRUE(eventually([&] { return finished == 12; }));
+        EXPECT_EQ(peak, 3);
+    }
+
+    peak = 0;
+    finished = 0;
+    {
+        // Two 60-byte jobs never fit a 100-byte budget together; a job over
+        // the budget still runs on its own
+        AdmissionController controller({3, 100});
+        for (int i = 0; i < 6; ++i) controller.submit(QueryPriority::INTERACTIVE, 60, job);
+        controller.submit(QueryPriority::INTERACTIVE, 500, job);
+        ASSERT_TRUE(eventually([&] { return finished == 7; }));
+        EXPECT_EQ(peak, 1);
+        EXPECT_EQ(controller.stats().memory_in_use, 0);
+    }
+}
+
+TEST(AdmissionControllerTest, AdmitsInteractiveQueriesAheadOfBatch) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::mutex order_mutex;
+    std::vector<std::string> order;
+    auto record = [&](std::string name) {
+        return [&, name] {
+            std::lock_guard<std::mutex> lock(order_mutex);
+            order.push_back(name);
+        };
+    };
+
+    AdmissionController controller({1, size_t(1) << 20});
+    controller.submit(QueryPriority::BATCH, 0, [released] { released.wait(); });
+    ASSERT_TRUE(eventually([&] { return controller.stats().in_flight == 1; }));
+    controller.submit(QueryPriority::BATCH, 0, record("batch"));
+    controller.submit(QueryPriority::INTERACTIVE, 0, record("first"));
+    controller.submit(QueryPriority::INTERACTIVE, 0, record("second"));
+    EXPECT_EQ(controller.stats().queued_batch, 1);
+    EXPECT_EQ(controller.stats().queued_interactive, 2);
+
+    release.set_value();
+    ASSERT_TRUE(eventually([&] {
+        std::lock_guard<std::mutex> lock(order_mutex);
+        return order.size() == 3;
+    }));
+    EXPECT_EQ(order, (std::vector<std::string>{"first", "second", "batch"}));
+}
+
+TEST(AdmissionControllerTest, KeepsASlotFreeForInteractiveQueries) {
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    std::atomic<bool> interactive_ran{false};
+
+    AdmissionController controller({2, size_t(1) << 20});
+    controller.submit(QueryPriority::BATCH, 0, [released] { released.wait(); });
+    controller.submit(QueryPriority::BATCH, 0, [released] { released.wait(); });
+    ASSERT_TRUE(eventually([&] { return controller.stats().in_flight == 1; }));
+    EXPECT_EQ(controller.stats().queued_batch, 1);
+
+    controller.submit(QueryPriority::INTERACTIVE, 0, [&] { interactive_ran = true; });
+    EXPECT_TRUE(eventually([&] { return interactive_ran.load(); }));
+    release.set_value();
+}
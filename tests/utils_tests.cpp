@@ -32,4 +32,10 @@ TEST(StringUtilsTest, SplitCSVFunction) {
     
     std::vector<std::string> expected4 = {"a", "b", ""};
     EXPECT_EQ(aqe::utils::splitCSV("a,b,"), expected4);
-}
\ No newline at end of file
+}
+TEST(StringUtilsTest, FormatFixedMatchesToString) {
+    for (double value : {0.0, -0.5, 1.0 / 3.0, 275.057925, 1e12, -123456.789}) {
+        EXPECT_EQ(aqe::utils::formatFixed(value), std::to_string(value));
+    }
+    EXPECT_EQ(aqe::utils::formatFixed(2.5, 1), "2.5");
+}